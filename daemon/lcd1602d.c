@@ -0,0 +1,226 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602d: shares lcd1602 panels among processes through shared-memory framebuffers
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lcd1602/lcd1602.h"
+#include "lcd1602/lcd1602d.h"
+
+#define MSG(...) fprintf(stderr, __VA_ARGS__)
+
+#define LCD1602D_MAX_PANELS     8
+#define LCD1602D_DEFAULT_FPS    20
+#define LCD1602D_STUCK_FRAMES   100 /* a row left odd this long belongs to a client that died mid-write */
+#define LCD1602D_DEFAULT_MODE   0660 /* framebuffer permissions: the daemon's user and group may draw */
+
+typedef struct
+{
+   char name[64];               /* shared-memory object name */
+   lcd1602_context lcd;
+   lcd1602_screen screen;
+   lcd1602d_framebuffer *fb;
+   uint16_t rows;               /* panel size; the framebuffer's copy is writable by clients */
+   uint16_t columns;
+   uint32_t sequence[LCD1602D_ROWS]; /* last sequence copied to the screen */
+   uint32_t stuck[LCD1602D_ROWS];
+} panel_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signum)
+{
+   (void) signum;
+   running = 0;
+}
+
+static void usage(const char *program)
+{
+   MSG("Usage: %s [-f fps] [-m mode] device:address[:rowsxcolumns] ...\n", program);
+   MSG("   -m sets the framebuffers' permissions, in octal (default %o)\n", LCD1602D_DEFAULT_MODE);
+   MSG("   e.g. %s -f 30 /dev/i2c-1:0x27:2x16 /dev/i2c-1:0x3f:4x20\n", program);
+}
+
+static void panel_close(panel_t *p)
+{
+   if(NULL != p->fb)
+   {
+      munmap(p->fb, sizeof(*p->fb));
+      shm_unlink(p->name);
+   }
+   if(NULL != p->screen)
+      lcd1602_screen_destroy(p->screen);
+   if(NULL != p->lcd)
+      lcd1602_deinit(p->lcd);
+}
+
+static int panel_open(panel_t *p, char *spec, mode_t mode)
+{
+   i2c_lowlevel_config config = {0};
+   unsigned int address, rows = 2, columns = 16;
+   char *device = strtok(spec, ":");
+   char *text = strtok(NULL, ":");
+   char *size = strtok(NULL, ":");
+   int fd;
+
+   memset(p, 0, sizeof(*p));
+   if(NULL == device || NULL == text || sscanf(text, "%i", &address) != 1
+   || (NULL != size && sscanf(size, "%ux%u", &rows, &columns) != 2)
+   || rows > LCD1602D_ROWS || columns > LCD1602D_COLUMNS)
+   {
+      MSG("Invalid panel specification\n");
+      return -1;
+   }
+
+   p->rows = (uint16_t) rows;
+   p->columns = (uint16_t) columns;
+   p->screen = lcd1602_screen_create(rows, columns);
+   if(NULL == p->screen)
+      return -1;
+
+   config.device = device;
+   p->lcd = lcd1602_init((uint8_t) address, true, &config);
+   if(NULL == p->lcd)
+   {
+      MSG("Failed to initialize panel 0x%02x on %s\n", address, device);
+      return -1;
+   }
+
+   snprintf(p->name, sizeof(p->name), "/lcd1602-%s-%02x", basename(device), address);
+   fd = shm_open(p->name, O_RDWR | O_CREAT | O_TRUNC, mode);
+   if(fd < 0)
+   {
+      MSG("Failed to create shared memory '%s'\n", p->name);
+      return -1;
+   }
+   fchmod(fd, mode); /* not reduced by the umask */
+   if(ftruncate(fd, sizeof(*p->fb)) != 0)
+   {
+      close(fd);
+      return -1;
+   }
+   p->fb = (lcd1602d_framebuffer *) mmap(NULL, sizeof(*p->fb), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if(MAP_FAILED == p->fb)
+   {
+      p->fb = NULL;
+      return -1;
+   }
+
+   memset(p->fb->cells, ' ', sizeof(p->fb->cells));
+   p->fb->rows = rows;
+   p->fb->columns = columns;
+   p->fb->version = LCD1602D_VERSION;
+   __atomic_store_n(&p->fb->magic, LCD1602D_MAGIC, __ATOMIC_RELEASE);
+
+   MSG("Panel 0x%02x on %s (%ux%u): %s\n", address, device, rows, columns, p->name);
+   return 0;
+}
+
+/* Copies rows that clients have finished changing to the panel's screen; returns true if any changed */
+static bool panel_poll(panel_t *p)
+{
+   char text[LCD1602D_COLUMNS + 1];
+   bool changed = false;
+   uint16_t row, column;
+
+   for(row = 0; row < p->rows; ++row)
+   {
+      uint32_t before = __atomic_load_n(&p->fb->sequence[row], __ATOMIC_ACQUIRE);
+      uint32_t after;
+
+      if(before == p->sequence[row])
+         continue;
+      if(before & 1)
+      {
+         if(++p->stuck[row] >= LCD1602D_STUCK_FRAMES)
+         {
+            __atomic_compare_exchange_n(&p->fb->sequence[row], &before, before + 1, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            p->stuck[row] = 0;
+         }
+         continue;
+      }
+      p->stuck[row] = 0;
+
+      for(column = 0; column < p->columns; ++column)
+      {
+         uint8_t cell = p->fb->cells[row][column];
+         text[column] = (cell < ' ') ? ' ' : (char) cell;
+      }
+      text[column] = '\0';
+
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      after = __atomic_load_n(&p->fb->sequence[row], __ATOMIC_RELAXED);
+      if(after != before)
+         continue; /* a client wrote during the copy; try again next frame */
+
+      lcd1602_screen_string(p->screen, row, 0, text);
+      p->sequence[row] = before;
+      changed = true;
+   }
+
+   return changed;
+}
+
+int main(int argc, char *argv[])
+{
+   panel_t panels[LCD1602D_MAX_PANELS];
+   int option, count = 0, fps = LCD1602D_DEFAULT_FPS, i, result = 0;
+   unsigned long mode = LCD1602D_DEFAULT_MODE;
+   char *end;
+
+   while((option = getopt(argc, argv, "f:m:h")) != -1)
+   {
+      switch(option)
+      {
+         case 'f':
+            fps = atoi(optarg);
+            break;
+         case 'm':
+            mode = strtoul(optarg, &end, 8);
+            if(end == optarg || *end != '\0' || mode > 0777)
+            {
+               usage(argv[0]);
+               return -1;
+            }
+            break;
+         default:
+            usage(argv[0]);
+            return -1;
+      }
+   }
+   if(optind >= argc || fps <= 0 || argc - optind > LCD1602D_MAX_PANELS)
+   {
+      usage(argv[0]);
+      return -1;
+   }
+
+   signal(SIGINT, stop);
+   signal(SIGTERM, stop);
+
+   for(i = optind; i < argc && 0 == result; ++i, ++count)
+      result = panel_open(&panels[count], argv[i], (mode_t) mode);
+
+   while(running && 0 == result)
+   {
+      for(i = 0; i < count; ++i)
+      {
+         if(panel_poll(&panels[i]))
+            lcd1602_screen_show(panels[i].lcd, panels[i].screen, 0);
+      }
+      usleep(1000000 / fps);
+   }
+
+   for(i = 0; i < count; ++i)
+      panel_close(&panels[i]);
+
+   return result;
+}
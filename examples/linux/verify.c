@@ -0,0 +1,1406 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 library verification against a reference HD44780 model
+ *
+ * Replaces the library's i2c and time functions with a simulated PCF8574 and HD44780 running on a
+ * virtual clock, then runs the same randomized sequence of API calls through each write mode. For each
+ * mode, the final panel contents are compared with an independent model of what the API calls asked for,
+ * every instruction is checked against the controller's timing requirements, and the bus traffic is
+ * compared with a budget so that a throughput regression is reported as a failure. Traffic per operation
+ * varies with the seed, and more so in short runs, so the budget is only checked in runs of at least
+ * BUDGET_MIN_OPERATIONS.
+ *
+ * A threaded case then streams text from a background thread while the main thread issues urgent writes,
+ * checking that each urgent write starts within the documented bound.
+ *
+ * Usage: lcd1602_verify [-n operations] [-s seed] [-v]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "lcd1602/lcd1602.h"
+
+#define MSG(...) fprintf(stderr, __VA_ARGS__)
+
+#define DDRAM_LINE_LENGTH  40
+#define DDRAM_SIZE         80
+#define CGRAM_SIZE         64
+#define GLYPH_SIZE         8
+#define BUS_SPEED          400000 /* hz, the library's default until calibration changes it */
+#define BITS_PER_BYTE      9
+
+/* HD44780 execution times (microseconds), from the datasheet at 270 kHz */
+#define EXEC_CLEAR_HOME    1520
+#define EXEC_DEFAULT       37
+#define EXEC_POWER_ON      15000
+#define EXEC_INIT_FIRST    4100 /* first 8-bit function set of initialization by instruction */
+#define EXEC_INIT_SECOND   100
+#define ENABLE_PULSE_NS    450
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Virtual clock and i2c bus
+ */
+
+static uint64_t now_ns;     /* virtual time */
+static uint64_t bus_free;   /* virtual time when the bus finishes the last queued transfer */
+static bool bus_async;      /* if set, writes return before their transfer completes */
+static uint32_t bus_speed;  /* hz */
+static uint64_t bus_bytes, bus_transfers, bus_time;
+static pthread_mutex_t clock_mutex = PTHREAD_MUTEX_INITIALIZER; /* for the threaded case */
+
+/* Urgent write latency, in bytes that other threads send first */
+typedef enum { URGENT_IDLE, URGENT_ARMED, URGENT_WAITING } eUrgentState;
+static eUrgentState urgent_state;
+static pthread_t urgent_thread;
+static uint64_t urgent_start;   /* bus_bytes when the urgent writer asked for the library's mutex */
+static uint64_t urgent_worst;
+static uint32_t urgent_delayed; /* urgent writes that waited for another thread's bytes */
+
+typedef void *i2c_lowlevel_context;
+typedef void *mutex_lowlevel;
+int sys_delay_us(size_t x);
+uint64_t sys_microsecond_tick(void);
+i2c_lowlevel_context i2c_ll_init(uint8_t i2c_address, uint32_t i2c_speed, uint32_t i2c_timeout_ms,
+                                 i2c_lowlevel_config *config);
+bool i2c_ll_deinit(i2c_lowlevel_context ctx);
+bool i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
+bool i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
+bool i2c_ll_set_speed(i2c_lowlevel_context ctx, uint32_t i2c_speed);
+mutex_lowlevel sys_mutex_init(void);
+bool sys_mutex_deinit(mutex_lowlevel mutex);
+bool sys_mutex_lock(mutex_lowlevel mutex);
+bool sys_mutex_unlock(mutex_lowlevel mutex);
+
+/* -----------------------------------------------------------------------------------------------------------
+ * HD44780 behind a PCF8574, in 2-line mode
+ */
+
+typedef struct
+{
+   uint8_t ddram[128];   /* by DDRAM address */
+   uint8_t cgram[CGRAM_SIZE];
+   uint8_t address;      /* address counter */
+   bool cgramSelected;
+   bool increment;
+   bool autoShift;
+   uint8_t control;      /* display, cursor, blink */
+   uint8_t shift;
+   bool eightBit;
+   bool pendingNibble;   /* 4-bit mode: upper nibble received */
+   bool dropNibbles;     /* 4-bit mode: the upper nibble arrived while busy */
+   uint8_t upper;
+   uint32_t initSteps;   /* 8-bit function sets received, for initialization timing */
+
+   uint8_t output;       /* PCF8574 output latch */
+   uint64_t enableRise;
+   uint64_t busyUntil;
+   bool readLower;       /* next read nibble is the lower one */
+   uint8_t readValue;
+   uint8_t readNibble;
+
+   uint32_t violations;
+   bool quiet;           /* violations are expected, e.g. during calibration */
+} model_t;
+
+static model_t panel;
+
+static void model_power_on(model_t *m)
+{
+   memset(m, 0, sizeof(*m));
+   memset(m->ddram, 0x20, sizeof(m->ddram)); /* not guaranteed by the datasheet, but typical */
+   m->eightBit = true;
+   m->increment = true;
+   m->busyUntil = (uint64_t) EXEC_POWER_ON * 1000;
+}
+
+static void model_violation(model_t *m, uint64_t time, const char *what)
+{
+   if(m->violations++ < 10 && !m->quiet)
+      printf("   timing/protocol violation at %.1f us: %s\n", time / 1000.0, what);
+}
+
+static void model_step(model_t *m, bool forward)
+{
+   if(m->cgramSelected)
+   {
+      m->address = (m->address + ((forward) ? 1 : -1)) & 0x7f; /* the counter has 7 bits */
+      return;
+   }
+   if(forward)
+      m->address = (0x27 == m->address) ? 0x40 : (0x67 == m->address) ? 0x00 : m->address + 1;
+   else
+      m->address = (0x40 == m->address) ? 0x27 : (0x00 == m->address) ? 0x67 : m->address - 1;
+}
+
+static void model_execute(model_t *m, uint8_t value, bool isData, uint64_t time)
+{
+   uint32_t exec = EXEC_DEFAULT;
+
+   if(time < m->busyUntil)
+   {
+      /* The controller ignores it, which is what calibration relies on to detect short delays */
+      model_violation(m, time, (isData) ? "data written while busy" : "instruction written while busy");
+      return;
+   }
+
+   if(isData)
+   {
+      if(m->cgramSelected)
+         m->cgram[m->address & (CGRAM_SIZE - 1)] = value;
+      else
+      {
+         m->ddram[m->address] = value;
+         if(m->autoShift)
+            m->shift = (m->shift + ((m->increment) ? 1 : DDRAM_LINE_LENGTH - 1)) % DDRAM_LINE_LENGTH;
+      }
+      model_step(m, m->increment);
+   }
+   else
+   {
+      if(value & 0x80)
+      {
+         m->cgramSelected = false;
+         m->address = value & 0x7f;
+         if((m->address & 0x3f) >= DDRAM_LINE_LENGTH)
+            model_violation(m, time, "invalid DDRAM address");
+      }
+      else if(value & 0x40)
+      {
+         m->cgramSelected = true;
+         m->address = value & 0x3f;
+      }
+      else if(value & 0x20)
+      {
+         if(m->eightBit && (value & 0x10))
+         {
+            ++m->initSteps;
+            if(1 == m->initSteps)
+               exec = EXEC_INIT_FIRST;
+            else if(2 == m->initSteps)
+               exec = EXEC_INIT_SECOND;
+         }
+         m->eightBit = (value & 0x10) != 0;
+         m->pendingNibble = false;
+      }
+      else if(value & 0x10)
+      {
+         if(value & 0x08) /* R/L (0x04) set shifts right */
+            m->shift = (m->shift + ((value & 0x04) ? DDRAM_LINE_LENGTH - 1 : 1)) % DDRAM_LINE_LENGTH;
+         else
+            model_step(m, (value & 0x04) != 0);
+      }
+      else if(value & 0x08)
+         m->control = value & 0x07;
+      else if(value & 0x04)
+      {
+         m->increment = (value & 0x02) != 0;
+         m->autoShift = (value & 0x01) != 0;
+      }
+      else if(value & 0x02)
+      {
+         m->cgramSelected = false;
+         m->address = 0;
+         m->shift = 0;
+         exec = EXEC_CLEAR_HOME;
+      }
+      else if(value & 0x01)
+      {
+         memset(m->ddram, 0x20, sizeof(m->ddram));
+         m->cgramSelected = false;
+         m->address = 0;
+         m->shift = 0;
+         m->increment = true;
+         exec = EXEC_CLEAR_HOME;
+      }
+   }
+
+   if(m->busyUntil < time)
+      m->busyUntil = time;
+   m->busyUntil += (uint64_t) exec * 1000;
+}
+
+/* The PCF8574 drives its outputs at the end of each byte; the controller latches on the falling edge
+   of E. While RW is high, the controller drives D4-D7 from the rising edge of E. */
+static void model_output(model_t *m, uint8_t value, uint64_t time)
+{
+   bool rise = !(m->output & 0x04) && (value & 0x04);
+   bool fall = (m->output & 0x04) && !(value & 0x04);
+   uint8_t latched = m->output;
+
+   m->output = value;
+   if(rise)
+   {
+      m->enableRise = time;
+      if(value & 0x02)
+      {
+         if(!m->readLower)
+         {
+            if(value & 0x01)
+               m->readValue = (m->cgramSelected) ? m->cgram[m->address & (CGRAM_SIZE - 1)] : m->ddram[m->address];
+            else
+               m->readValue = ((time < m->busyUntil) ? 0x80 : 0) | m->address;
+         }
+         m->readNibble = (m->readLower) ? (m->readValue << 4) : (m->readValue & 0xf0);
+      }
+   }
+   if(!fall)
+      return;
+
+   if(time - m->enableRise < ENABLE_PULSE_NS)
+      model_violation(m, time, "enable pulse too short");
+
+   if(latched & 0x02)
+   {
+      if(m->readLower && (latched & 0x01))
+         model_step(m, m->increment); /* data reads advance the address counter */
+      m->readLower = !m->readLower;
+      return;
+   }
+
+   if(m->eightBit)
+      model_execute(m, latched & 0xf0, latched & 0x01, time);
+   else if(!m->pendingNibble)
+   {
+      /* The busy flag covers the whole instruction. The model ignores all of it, like an instruction
+         completed while busy; a real controller may lose nibble sync instead. */
+      m->dropNibbles = (time < m->busyUntil);
+      if(m->dropNibbles)
+         model_violation(m, time, "instruction started while busy");
+      m->upper = latched & 0xf0;
+      m->pendingNibble = true;
+   }
+   else
+   {
+      m->pendingNibble = false;
+      if(!m->dropNibbles)
+         model_execute(m, m->upper | (latched >> 4), latched & 0x01, time);
+   }
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Library hooks
+ */
+
+int sys_delay_us(size_t x)
+{
+   pthread_mutex_lock(&clock_mutex);
+   now_ns += (uint64_t) x * 1000;
+   pthread_mutex_unlock(&clock_mutex);
+   sched_yield(); /* lets another thread run while this one polls, even on a single core */
+   return 0;
+}
+
+uint64_t sys_microsecond_tick(void)
+{
+   uint64_t now;
+   pthread_mutex_lock(&clock_mutex);
+   now = now_ns / 1000;
+   pthread_mutex_unlock(&clock_mutex);
+   return now;
+}
+
+mutex_lowlevel sys_mutex_init(void)
+{
+   pthread_mutex_t *mutex = malloc(sizeof(*mutex));
+   if(NULL != mutex)
+      pthread_mutex_init(mutex, NULL);
+   return mutex;
+}
+
+bool sys_mutex_deinit(mutex_lowlevel mutex)
+{
+   if(NULL != mutex)
+      pthread_mutex_destroy((pthread_mutex_t *) mutex);
+   free(mutex);
+   return true;
+}
+
+/* lcd1602_write_urgent() announces itself, then takes the mutex: that's where its wait begins */
+bool sys_mutex_lock(mutex_lowlevel mutex)
+{
+   pthread_mutex_lock(&clock_mutex);
+   if(URGENT_ARMED == urgent_state && pthread_equal(pthread_self(), urgent_thread))
+   {
+      urgent_state = URGENT_WAITING;
+      urgent_start = bus_bytes;
+   }
+   pthread_mutex_unlock(&clock_mutex);
+   pthread_mutex_lock((pthread_mutex_t *) mutex);
+   return true;
+}
+
+bool sys_mutex_unlock(mutex_lowlevel mutex)
+{
+   pthread_mutex_unlock((pthread_mutex_t *) mutex);
+   return true;
+}
+
+i2c_lowlevel_context i2c_ll_init(uint8_t i2c_address, uint32_t i2c_speed, uint32_t i2c_timeout_ms,
+                                 i2c_lowlevel_config *config)
+{
+   return &panel;
+}
+
+bool i2c_ll_deinit(i2c_lowlevel_context ctx)
+{
+   return true;
+}
+
+static bool bus_write(const uint8_t *data, uint16_t length)
+{
+   uint64_t byteTime, time;
+   uint16_t i;
+
+   pthread_mutex_lock(&clock_mutex);
+   if(URGENT_WAITING == urgent_state && pthread_equal(pthread_self(), urgent_thread))
+   {
+      if(bus_bytes - urgent_start > urgent_worst)
+         urgent_worst = bus_bytes - urgent_start;
+      if(bus_bytes > urgent_start)
+         ++urgent_delayed;
+      urgent_state = URGENT_IDLE;
+   }
+
+   byteTime = (uint64_t) BITS_PER_BYTE * 1000000000 / bus_speed;
+   time = (bus_free > now_ns) ? bus_free : now_ns;
+   time += byteTime; /* address */
+   for(i = 0; i < length; ++i)
+   {
+      time += byteTime;
+      model_output(&panel, data[i], time);
+   }
+
+   bus_bytes += length;
+   bus_transfers += 1;
+   bus_time += (length + 1) * byteTime;
+   bus_free = time;
+   if(!bus_async)
+      now_ns = time;
+   pthread_mutex_unlock(&clock_mutex);
+   return true;
+}
+
+static bool bus_read(uint8_t *data, uint16_t length)
+{
+   uint64_t byteTime, time;
+
+   pthread_mutex_lock(&clock_mutex);
+   byteTime = (uint64_t) BITS_PER_BYTE * 1000000000 / bus_speed;
+   time = (bus_free > now_ns) ? bus_free : now_ns;
+   memset(data, panel.readNibble | (panel.output & 0x0f), length);
+   bus_free = now_ns = time + (length + 1) * byteTime;
+   pthread_mutex_unlock(&clock_mutex);
+   return true;
+}
+
+bool i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+{
+   return bus_write(data, length);
+}
+
+bool i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+{
+   return bus_read(data, length);
+}
+
+bool i2c_ll_set_speed(i2c_lowlevel_context ctx, uint32_t i2c_speed)
+{
+   pthread_mutex_lock(&clock_mutex);
+   bus_free = now_ns = (bus_free > now_ns) ? bus_free : now_ns;
+   bus_speed = i2c_speed;
+   pthread_mutex_unlock(&clock_mutex);
+   return true;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Test transport: the same bus, with the capabilities passed as its config, so that the chunked,
+ * non-vectored and vectored paths are compared with the reference too
+ */
+
+static lcd1602_transport_caps test_caps;
+static uint32_t test_fixed_speed; /* hz of an adapter whose clock can't be set, like i2c-dev; 0 if it can */
+
+static void *test_open(const void *config, uint8_t i2cAddress, uint32_t busSpeed, uint32_t timeoutMs,
+   lcd1602_transport_caps *caps)
+{
+   test_caps = *caps = *(const lcd1602_transport_caps *) config;
+   return &panel;
+}
+
+static void test_close(void *handle)
+{
+}
+
+static bool test_write(void *handle, const uint8_t *data, uint16_t length)
+{
+   if(length > test_caps.maxWrite)
+   {
+      model_violation(&panel, now_ns, "write longer than the transport accepts");
+      return false;
+   }
+   return bus_write(data, length);
+}
+
+static bool test_read(void *handle, uint8_t *data, uint16_t length)
+{
+   if(!test_caps.read)
+   {
+      model_violation(&panel, now_ns, "read from a transport without reads");
+      return false;
+   }
+   return bus_read(data, length);
+}
+
+/* The segments are sent back to back as one transfer, each with its own address byte */
+static bool test_transfer(void *handle, const lcd1602_transport_segment *segments, uint16_t count)
+{
+   uint64_t transfers = bus_transfers;
+   uint16_t i;
+
+   if(!test_caps.vectored)
+   {
+      model_violation(&panel, now_ns, "transfer on a transport without vectored support");
+      return false;
+   }
+   for(i = 0; i < count; ++i)
+   {
+      if(segments[i].read)
+         bus_read(segments[i].data, segments[i].length);
+      else
+         bus_write(segments[i].data, segments[i].length);
+   }
+   bus_transfers = transfers + 1;
+   return true;
+}
+
+static bool test_set_speed(void *handle, uint32_t busSpeed)
+{
+   if(0 != test_fixed_speed)
+      return false;
+   return i2c_ll_set_speed(handle, busSpeed);
+}
+
+static const lcd1602_transport test_transport = {
+   .name = "test",
+   .open = test_open,
+   .close = test_close,
+   .write = test_write,
+   .read = test_read,
+   .transfer = test_transfer,
+   .set_speed = test_set_speed
+};
+
+static const lcd1602_transport_caps caps_byte = { 1, false, false }; /* e.g. SMBus send byte only */
+static const lcd1602_transport_caps caps_chunked = { 4, true, false };
+static const lcd1602_transport_caps caps_vectored = { 64, true, true };
+static const lcd1602_transport_caps caps_i2cdev = { 255, true, true };
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Reference: what the API calls ask for, independent of how the library sends it
+ */
+
+#define REF_BAR(fill)  (0x100 | (fill)) /* cell showing a bar glyph with "fill" pixel columns */
+#define REF_GLYPH(n)   (0x200 | (n))    /* cell showing ref_glyphs[n] */
+
+/* Glyphs the library loads into CGRAM on demand. When no slot is free, characters fall back to a ROM
+   code instead. */
+typedef struct
+{
+   uint8_t bitmap[GLYPH_SIZE];
+   int fallback;               /* ROM code shown instead, or -1 if the call fails */
+} ref_glyph_t;
+
+enum { GLYPH_BIG2_TOP, GLYPH_BIG2_BOTTOM, GLYPH_BIG2_BOTH, GLYPH_BIG4_UPPER, GLYPH_BIG4_LOWER,
+       GLYPH_BACKSLASH, GLYPH_E_ACUTE, GLYPH_EURO };
+
+static const ref_glyph_t ref_glyphs[] = {
+   { { 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00 }, -1 },
+   { { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f }, -1 },
+   { { 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x1f, 0x1f, 0x1f }, -1 },
+   { { 0x1f, 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00 }, -1 },
+   { { 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f, 0x1f }, -1 },
+   { { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00 }, '?' },
+   { { 0x02, 0x04, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00 }, '?' },
+   { { 0x06, 0x09, 0x1c, 0x08, 0x1c, 0x09, 0x06, 0x00 }, '?' },
+};
+
+static uint32_t glyphs_shown, glyphs_replaced; /* on-demand glyph cells compared: as glyphs, as fallbacks */
+
+typedef struct
+{
+   uint16_t ddram[DDRAM_SIZE];  /* by index: line 0, then line 1 */
+   uint8_t cgram[CGRAM_SIZE];
+   uint8_t index;
+   bool increment;
+   bool autoShift;
+   uint8_t control;
+   uint8_t shift;
+} reference_t;
+
+static const uint8_t row_offset[4] = { 0x00, 0x40, 0x14, 0x54 };
+
+static uint8_t ref_index(uint8_t address)
+{
+   return ((address & 0x40) ? DDRAM_LINE_LENGTH : 0) + (address & 0x3f);
+}
+
+static void ref_reset(reference_t *r)
+{
+   uint8_t i;
+   memset(r, 0, sizeof(*r));
+   for(i = 0; i < DDRAM_SIZE; ++i)
+      r->ddram[i] = ' ';
+   r->increment = true;
+   r->control = 0x04;
+}
+
+static void ref_step(reference_t *r, bool forward)
+{
+   r->index = (r->index + ((forward) ? 1 : DDRAM_SIZE - 1)) % DDRAM_SIZE;
+}
+
+static void ref_char(reference_t *r, uint16_t c)
+{
+   r->ddram[r->index] = c;
+   if(r->autoShift)
+      r->shift = (r->shift + ((r->increment) ? 1 : DDRAM_LINE_LENGTH - 1)) % DDRAM_LINE_LENGTH;
+   ref_step(r, r->increment);
+}
+
+/* Resolves a cell to what the panel shows: a character ROM code, or a glyph bitmap */
+static void cell_appearance(uint16_t cell, const uint8_t *cgram, uint8_t *bitmap, int *code)
+{
+   *code = -1;
+   if(cell & 0x200)
+      memcpy(bitmap, ref_glyphs[cell & 0xff].bitmap, GLYPH_SIZE);
+   else if(cell & 0x100)
+   {
+      uint8_t fill = cell & 0xff;
+      memset(bitmap, (0x1f << (5 - fill)) & 0x1f, GLYPH_SIZE);
+   }
+   else if(cell < 16)
+      memcpy(bitmap, &cgram[(cell & 0x07) * GLYPH_SIZE], GLYPH_SIZE);
+   else
+      *code = cell;
+}
+
+/* The ROM code the library may show instead of an on-demand glyph, or -1 */
+static int cell_fallback(uint16_t cell)
+{
+   if(cell & 0x200)
+      return ref_glyphs[cell & 0xff].fallback;
+   if(cell & 0x100)
+      return ((cell & 0xff) * 2 >= 5) ? 0xff : ' '; /* bars round to the nearest whole cell */
+   return -1;
+}
+
+/* Returns the number of differences, describing up to "reports" of them */
+static int compare(const reference_t *r, const model_t *m, int reports)
+{
+   int errors = 0, index;
+
+   for(index = 0; index < DDRAM_SIZE; ++index)
+   {
+      uint8_t address = (index < DDRAM_LINE_LENGTH) ? index : 0x40 + index - DDRAM_LINE_LENGTH;
+      uint8_t expectedBitmap[GLYPH_SIZE], actualBitmap[GLYPH_SIZE];
+      int expectedCode, actualCode;
+
+      cell_appearance(r->ddram[index], r->cgram, expectedBitmap, &expectedCode);
+      cell_appearance(m->ddram[address], m->cgram, actualBitmap, &actualCode);
+      if(expectedCode != actualCode
+      || (expectedCode < 0 && memcmp(expectedBitmap, actualBitmap, GLYPH_SIZE) != 0))
+      {
+         if(cell_fallback(r->ddram[index]) >= 0 && cell_fallback(r->ddram[index]) == actualCode)
+         {
+            ++glyphs_replaced;
+            continue;
+         }
+         if(errors++ < reports)
+            printf("   DDRAM 0x%02x: expected 0x%03x, panel has 0x%02x\n", address, r->ddram[index], m->ddram[address]);
+      }
+      else if(r->ddram[index] & 0x300)
+         ++glyphs_shown;
+   }
+
+   if(r->shift != m->shift)
+   {
+      if(errors < reports)
+         printf("   display shift: expected %u, panel has %u\n", r->shift, m->shift);
+      ++errors;
+   }
+   if(r->control != m->control)
+   {
+      if(errors < reports)
+         printf("   display control: expected 0x%x, panel has 0x%x\n", r->control, m->control);
+      ++errors;
+   }
+   if((r->control & 0x04) && (r->control & 0x03)
+   && (m->cgramSelected || ref_index(m->address) != r->index))
+   {
+      if(errors < reports)
+         printf("   visible cursor: expected index %u, panel at 0x%02x\n", r->index, m->address);
+      ++errors;
+   }
+   return errors;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Randomized API sequences
+ */
+
+typedef struct
+{
+   const char *name;
+   bool writeBehind;
+   uint32_t maxFps;
+   bool async;
+   bool calibrate;    /* run lcd1602_calibrate() first and use the profile it finds */
+   uint32_t batchMs;  /* power-save mode's batch window, replacing writeBehind and maxFps; 0 for none */
+   double budget;     /* maximum PCF8574 bytes per operation */
+   const lcd1602_transport_caps *caps; /* run through the test transport with these; NULL for i2c_ll */
+   uint32_t fixedSpeed; /* hz the test transport's bus runs at, refusing speed changes; 0 if it follows them */
+} verify_mode_t;
+
+/* Each budget is about 15% above the most traffic seen over seeds 1-60 with 1000, 2000, 3000 and 10000
+   operations. Re-measure them that way when the operation mix changes. */
+static const verify_mode_t modes[] = {
+   { "direct",                    false, 0,  false, false, 0,  48.0 },
+   { "direct, async",             false, 0,  true,  false, 0,  48.0 },
+   { "write-behind",              true,  0,  false, false, 0,  48.0 },
+   { "write-behind 20fps, async", true,  20, true,  false, 0,  21.0 },
+   { "direct, calibrated",        false, 0,  false, true,  0,  68.0 },
+   { "power save 50ms, async",    true,  0,  true,  false, 50, 23.0 },
+   { "1-byte writes",             false, 0,  false, false, 0,  48.0, &caps_byte },
+   { "4-byte writes, calibrated", false, 0,  false, true,  0,  62.0, &caps_chunked },
+   { "vectored, write-behind",    true,  0,  false, true,  0,  70.0, &caps_vectored },
+   { "fixed 1 MHz clock",         false, 0,  false, false, 0,  68.0, &caps_i2cdev, 1000000 },
+};
+
+#define BUDGET_MIN_OPERATIONS 1000 /* shorter runs report their traffic without checking it */
+
+#define CHECK_INTERVAL 50 /* operations between comparisons with the reference */
+#define SCREEN_COUNT 2
+#define SCREEN_COLUMNS DDRAM_LINE_LENGTH
+#define LOG_ROW 2
+#define LOG_ROWS 2
+#define LOG_COLUMNS 20
+#define POWER_IDLE_MS 200
+
+static void select_write_mode(lcd1602_context ctx, const verify_mode_t *mode)
+{
+   if(mode->batchMs > 0)
+      lcd1602_set_power_save(ctx, mode->batchMs, POWER_IDLE_MS);
+   else
+      lcd1602_set_write_behind(ctx, mode->writeBehind, mode->maxFps);
+}
+
+static uint32_t random_state;
+
+static uint32_t random_next(uint32_t range)
+{
+   random_state = random_state * 1103515245 + 12345;
+   return ((random_state >> 8) & 0xffffff) % range;
+}
+
+static void random_text(char *s, uint32_t length)
+{
+   uint32_t i;
+   for(i = 0; i < length; ++i)
+      s[i] = (char) (0x20 + random_next(0x5e));
+   s[length] = '\0';
+}
+
+/* UTF-8 characters and what the A00 ROM shows for them */
+typedef struct
+{
+   const char *utf8;
+   uint16_t cell;
+} utf8_char_t;
+
+static const utf8_char_t utf8_chars[] = {
+   { "\xc2\xb0", 0xdf },                          /* degree sign */
+   { "\xc2\xb5", 0xe4 },                          /* micro sign */
+   { "\xc2\xa5", 0x5c },                          /* yen sign */
+   { "\xc3\xb6", 0xef },                          /* o diaeresis */
+   { "\xcf\x80", 0xf7 },                          /* pi */
+   { "\xe2\x86\x92", 0x7e },                      /* rightwards arrow */
+   { "\xe2\x88\x9e", 0xf3 },                      /* infinity */
+   { "\\", REF_GLYPH(GLYPH_BACKSLASH) },         /* A00 shows a yen sign instead */
+   { "\xc3\xa9", REF_GLYPH(GLYPH_E_ACUTE) },
+   { "\xe2\x82\xac", REF_GLYPH(GLYPH_EURO) },
+   { "\xc3\xa2", '?' },                           /* a circumflex: neither in the ROM nor a glyph */
+   { "\xe2\x98\x83", '?' },                       /* snowman */
+   { "\xc0\xaf", '?' },                           /* malformed: overlong '/' */
+   { "\xe0\x80\xaf", '?' },                       /* malformed: overlong '/' */
+   { "\xf0\x82\x82\xac", '?' },                   /* malformed: overlong euro sign */
+   { "\xed\xa0\x80", '?' },                       /* malformed: surrogate U+D800 */
+   { "\xf4\x90\x80\x80", '?' },                   /* malformed: beyond U+10FFFF */
+};
+
+/* Large fonts: cells of the 2-row font ('F'ull, 'T'op, 'B'ottom, 'H' both bars), and the pixels of the
+   4-row font as 8 half-block rows of 3 bits (bit 2 is the left column), by "0123456789-" */
+static const char *const big2_cells[11][2] = {
+   { "FTF", "FBF" }, { "TF ", "BFB" }, { "HHF", "FBB" }, { "HHF", "BBF" }, { "FBF", "  F" }, { "FHH", "BBF" },
+   { "FHH", "FBF" }, { "TTF", "  F" }, { "FHF", "FBF" }, { "FHF", "BBF" }, { "BBB", "   " }
+};
+static const uint8_t big4_pixels[11][8] = {
+   { 7, 5, 5, 5, 5, 5, 5, 7 }, { 2, 6, 2, 2, 2, 2, 2, 7 }, { 7, 1, 1, 7, 4, 4, 4, 7 }, { 7, 1, 1, 7, 1, 1, 1, 7 },
+   { 5, 5, 5, 7, 1, 1, 1, 1 }, { 7, 4, 4, 7, 1, 1, 1, 7 }, { 7, 4, 4, 7, 5, 5, 5, 7 }, { 7, 1, 1, 1, 1, 1, 1, 1 },
+   { 7, 5, 5, 7, 5, 5, 5, 7 }, { 7, 5, 5, 7, 1, 1, 1, 7 }, { 0, 0, 0, 7, 0, 0, 0, 0 }
+};
+
+static uint16_t big_cell(char c, uint16_t height, uint16_t row, uint16_t column)
+{
+   const char *digits = "0123456789-";
+   const char *found = strchr(digits, c);
+   bool upper, lower;
+
+   if(' ' == c || NULL == found)
+      return ' ';
+   if(2 == height)
+   {
+      switch(big2_cells[found - digits][row][column])
+      {
+         case 'F': return 0xff;
+         case 'T': return REF_GLYPH(GLYPH_BIG2_TOP);
+         case 'B': return REF_GLYPH(GLYPH_BIG2_BOTTOM);
+         case 'H': return REF_GLYPH(GLYPH_BIG2_BOTH);
+         default:  return ' ';
+      }
+   }
+   upper = (big4_pixels[found - digits][row * 2] >> (2 - column)) & 1;
+   lower = (big4_pixels[found - digits][row * 2 + 1] >> (2 - column)) & 1;
+   return (upper && lower) ? 0xff : (upper) ? REF_GLYPH(GLYPH_BIG4_UPPER)
+        : (lower) ? REF_GLYPH(GLYPH_BIG4_LOWER) : ' ';
+}
+
+static const uint8_t glyph0[GLYPH_SIZE] = { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e };
+static const uint8_t glyph1[GLYPH_SIZE] = { 0x04, 0x0e, 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04 };
+
+/* Reattaches to the panel as a restarted application would: warm, or with a full reset */
+static lcd1602_context reopen(const verify_mode_t *mode, bool warm, const lcd1602_snapshot *snapshot)
+{
+   i2c_lowlevel_config config = {0};
+   const lcd1602_transport *transport = (NULL != mode->caps) ? &test_transport : &lcd1602_transport_sys;
+   const void *transportConfig = (NULL != mode->caps) ? (const void *) mode->caps : (const void *) &config;
+
+   if(!warm)
+      return lcd1602_init_transport(LCD1602_I2C_ADDRESS_DEFAULT, true, transport, transportConfig);
+   if(NULL == mode->caps)
+      return lcd1602_init_warm(LCD1602_I2C_ADDRESS_DEFAULT, true, &config, snapshot);
+   return lcd1602_init_warm_transport(LCD1602_I2C_ADDRESS_DEFAULT, true, transport, transportConfig, snapshot);
+}
+
+static int run(const verify_mode_t *mode, uint32_t seed, uint32_t operations, bool verbose)
+{
+   i2c_lowlevel_config config = {0};
+   lcd1602_context ctx;
+   lcd1602_screen screens[SCREEN_COUNT];
+   lcd1602_log log;
+   char logLines[LOG_ROWS][LCD1602_LOG_LINE_LENGTH + 1]; /* newest last */
+   uint16_t logOffset = 0;
+   uint16_t screenCells[SCREEN_COUNT][DDRAM_SIZE];
+   reference_t ref;
+   lcd1602_timing timing;
+   uint64_t startTime, startBytes, startTransfers, startBusTime;
+   uint32_t op, errors = 0, i;
+   double bytesPerOp;
+   bool overBudget;
+   int result;
+
+   now_ns = bus_free = 0;
+   bus_speed = (0 != mode->fixedSpeed) ? mode->fixedSpeed : BUS_SPEED;
+   test_fixed_speed = mode->fixedSpeed;
+   bus_bytes = bus_transfers = bus_time = 0;
+   bus_async = mode->async;
+   glyphs_shown = glyphs_replaced = 0;
+   random_state = seed;
+   model_power_on(&panel);
+   ref_reset(&ref);
+
+   if(NULL != mode->caps)
+      ctx = lcd1602_init_transport(LCD1602_I2C_ADDRESS_DEFAULT, true, &test_transport, mode->caps);
+   else
+      ctx = lcd1602_init(LCD1602_I2C_ADDRESS_DEFAULT, true, &config);
+   if(NULL == ctx)
+   {
+      printf("%s: initialization failed\n", mode->name);
+      return 1;
+   }
+
+   lcd1602_get_timing(ctx, &timing);
+   if(mode->calibrate)
+   {
+      panel.quiet = true;
+      result = lcd1602_calibrate(ctx, &timing);
+      panel.quiet = false;
+      if(result != 0)
+      {
+         printf("%s: calibration failed\n", mode->name);
+         lcd1602_deinit(ctx);
+         return 1;
+      }
+      if(verbose)
+         printf("   calibrated: %u Hz, settle %u us, clear %u us, mode set %u us\n", timing.busSpeed,
+            timing.settle, timing.clear, timing.modeSet);
+      panel.violations = 0; /* rejected candidates are expected to violate the timing */
+   }
+
+   for(i = 0; i < SCREEN_COUNT; ++i)
+   {
+      uint8_t cell;
+      screens[i] = lcd1602_screen_create(2, SCREEN_COLUMNS);
+      for(cell = 0; cell < DDRAM_SIZE; ++cell)
+         screenCells[i][cell] = ' ';
+   }
+
+   log = lcd1602_log_create(LOG_ROW, LOG_ROWS, LOG_COLUMNS, 8, 0);
+   for(i = 0; i < LOG_ROWS; ++i)
+      memset(logLines[i], ' ', LCD1602_LOG_LINE_LENGTH);
+
+   lcd1602_define_char(ctx, 0, glyph0);
+   lcd1602_define_char(ctx, 1, glyph1);
+   memcpy(&ref.cgram[0], glyph0, GLYPH_SIZE);
+   memcpy(&ref.cgram[GLYPH_SIZE], glyph1, GLYPH_SIZE);
+   select_write_mode(ctx, mode);
+
+   startTime = now_ns;
+   startBytes = bus_bytes;
+   startTransfers = bus_transfers;
+   startBusTime = bus_time;
+
+   for(op = 0; op < operations; ++op)
+   {
+      uint32_t choice = random_next(100);
+      char text[DDRAM_LINE_LENGTH + 1];
+
+      if(choice < 20)
+      {
+         uint16_t row = random_next(4), column = random_next(20);
+         lcd1602_set_cursor(ctx, row, column);
+         ref.index = ref_index(row_offset[row] + column);
+      }
+      else if(choice < 37)
+      {
+         random_text(text, 1 + random_next(8));
+         lcd1602_string(ctx, text);
+         for(i = 0; text[i] != '\0'; ++i)
+            ref_char(&ref, (uint8_t) text[i]);
+      }
+      else if(choice < 40)
+      {
+         uint16_t cells[8], count = 1 + random_next(8);
+         text[0] = '\0';
+         for(i = 0; i < count; ++i)
+         {
+            if(random_next(2) == 0)
+            {
+               const utf8_char_t *u = &utf8_chars[random_next(sizeof(utf8_chars) / sizeof(utf8_chars[0]))];
+               strcat(text, u->utf8);
+               cells[i] = u->cell;
+            }
+            else
+            {
+               char c[2] = { (char) (0x20 + random_next(0x5e)), '\0' };
+               if('\\' == c[0])
+                  c[0] = '/';
+               strcat(text, c);
+               cells[i] = (uint8_t) c[0];
+            }
+         }
+         lcd1602_string_utf8(ctx, text);
+         for(i = 0; i < count; ++i)
+            ref_char(&ref, cells[i]);
+      }
+      else if(choice < 51)
+      {
+         static const char custom[] = { 0x00, 0x01, 0x08, 0x09 };
+         char c = (random_next(4) == 0) ? custom[random_next(4)] : (char) (0x20 + random_next(0x5e));
+         lcd1602_char(ctx, c);
+         ref_char(&ref, (uint8_t) c);
+      }
+      else if(choice < 60)
+      {
+         /* Two fixed bars, whose partial cells compete for CGRAM slots with large and UTF-8 characters */
+         uint16_t row = random_next(2), width = 6, cell;
+         uint32_t maximum = 100, value = random_next(maximum + 1), pixels;
+         int index = ref_index(row_offset[row] + 10);
+         lcd1602_bar(ctx, row, 10, width, value, maximum);
+         pixels = value * width * 5 / maximum;
+         for(cell = 0; cell < width; ++cell)
+         {
+            uint32_t fill = (pixels > 5) ? 5 : pixels;
+            ref.ddram[index + cell] = (5 == fill) ? 0xff : (0 == fill) ? ' ' : REF_BAR(fill);
+            pixels -= fill;
+         }
+      }
+      else if(choice < 62)
+      {
+         static const char bigChars[] = "0123456789- ";
+         uint16_t height = (random_next(2) == 0) ? 2 : 4, length = 1 + random_next(3);
+         uint16_t row = (2 == height) ? 2 * random_next(2) : 0, column = random_next(20 - (length * 4 - 1) + 1);
+         uint16_t r, cell;
+         for(i = 0; i < length; ++i)
+            text[i] = bigChars[random_next(sizeof(bigChars) - 1)];
+         text[length] = '\0';
+         if(lcd1602_big_string(ctx, row, column, height, text) == 0)
+         {
+            for(r = 0; r < height; ++r)
+            {
+               int index = ref_index(row_offset[row + r] + column);
+               for(cell = 0; cell < length * 4 - 1; ++cell)
+                  ref.ddram[index + cell] = (3 == cell % 4) ? ' ' : big_cell(text[cell / 4], height, r, cell % 4);
+            }
+            ++glyphs_shown;
+         }
+         else
+            ++glyphs_replaced; /* no free CGRAM slots for the font */
+      }
+      else if(choice < 70)
+      {
+         bool display = random_next(2), left = random_next(2);
+         lcd1602_scroll(ctx, (display) ? LCD1602_SCROLL_DISPLAY : LCD1602_SCROLL_CURSOR,
+            (left) ? LCD1602_SCROLL_LEFT : LCD1602_SCROLL_RIGHT);
+         if(display)
+            ref.shift = (ref.shift + ((left) ? 1 : DDRAM_LINE_LENGTH - 1)) % DDRAM_LINE_LENGTH;
+         else
+            ref_step(&ref, !left);
+      }
+      else if(choice < 74)
+      {
+         /* Mostly left-to-right without auto-scroll, as applications use it */
+         bool leftToRight = random_next(4) != 0, autoScroll = random_next(4) == 0;
+         lcd1602_set_mode(ctx, leftToRight, autoScroll);
+         ref.increment = leftToRight;
+         ref.autoShift = autoScroll;
+      }
+      else if(choice < 78)
+      {
+         bool display = random_next(8) != 0, cursor = random_next(2), blink = random_next(2);
+         lcd1602_set_display(ctx, display, cursor, blink);
+         ref.control = ((display) ? 0x04 : 0) | ((cursor) ? 0x02 : 0) | ((blink) ? 0x01 : 0);
+      }
+      else if(choice < 81)
+      {
+         lcd1602_clear(ctx);
+         for(i = 0; i < DDRAM_SIZE; ++i)
+            ref.ddram[i] = ' ';
+         ref.index = 0;
+         ref.shift = 0;
+         ref.increment = true;
+      }
+      else if(choice < 85)
+      {
+         lcd1602_home(ctx);
+         ref.index = 0;
+         ref.shift = 0;
+      }
+      else if(choice < 93)
+      {
+         uint32_t screen = random_next(SCREEN_COUNT), row = random_next(2), column = random_next(SCREEN_COLUMNS);
+         random_text(text, 1 + random_next(12));
+         lcd1602_screen_string(screens[screen], row, column, text);
+         for(i = 0; text[i] != '\0' && column + i < SCREEN_COLUMNS; ++i)
+            screenCells[screen][row * DDRAM_LINE_LENGTH + column + i] = (uint8_t) text[i];
+      }
+      else if(choice < 94)
+      {
+         uint16_t row = random_next(4), column = random_next(20);
+         int index = ref_index(row_offset[row] + column);
+         random_text(text, 1 + random_next(8));
+         lcd1602_write_urgent(ctx, row, column, text);
+         for(i = 0; text[i] != '\0' && (row_offset[row] & 0x3f) + column + i < DDRAM_LINE_LENGTH; ++i)
+            ref.ddram[index + i] = (uint8_t) text[i];
+      }
+      else if(choice < 97)
+      {
+         if(random_next(4) == 0)
+         {
+            logOffset = random_next(LCD1602_LOG_LINE_LENGTH - LOG_COLUMNS);
+            lcd1602_log_set_offset(log, logOffset);
+         }
+         else
+         {
+            random_text(text, 1 + random_next(DDRAM_LINE_LENGTH));
+            lcd1602_log_append(log, text);
+            memmove(logLines[0], logLines[1], sizeof(logLines[0]) * (LOG_ROWS - 1));
+            memset(logLines[LOG_ROWS - 1], ' ', LCD1602_LOG_LINE_LENGTH);
+            memcpy(logLines[LOG_ROWS - 1], text, strlen(text));
+         }
+         if(random_next(2) == 0)
+         {
+            uint16_t row, column;
+            lcd1602_log_show(ctx, log);
+            for(row = 0; row < LOG_ROWS; ++row)
+               for(column = 0; column < LOG_COLUMNS; ++column)
+                  ref.ddram[ref_index(row_offset[LOG_ROW + row] + column)] = logLines[row][logOffset + column];
+         }
+      }
+      else if(choice < 99 || random_next(4) != 0)
+      {
+         uint32_t screen = random_next(SCREEN_COUNT), column = random_next(SCREEN_COLUMNS);
+         lcd1602_screen_show(ctx, screens[screen], column);
+         memcpy(ref.ddram, screenCells[screen], sizeof(ref.ddram));
+         ref.shift = column;
+      }
+      else
+      {
+         /* Restart: flush, save a snapshot if there's one to take, and attach again. Without reads, a
+            warm attach needs the snapshot. */
+         lcd1602_snapshot snapshot;
+         bool warm = random_next(4) != 0;
+         bool useSnapshot = (NULL != mode->caps && !mode->caps->read) || random_next(2) == 0;
+
+         lcd1602_set_write_behind(ctx, false, 0);
+         if(useSnapshot && lcd1602_get_snapshot(ctx, &snapshot) != 0)
+         {
+            printf("   no snapshot available\n");
+            ++errors;
+            useSnapshot = false;
+         }
+         lcd1602_deinit(ctx);
+         ctx = reopen(mode, warm, (useSnapshot) ? &snapshot : NULL);
+         if(NULL == ctx)
+         {
+            printf("   %s attach failed\n", (warm) ? "warm" : "cold");
+            ++errors;
+            break;
+         }
+         lcd1602_set_timing(ctx, &timing);
+         lcd1602_define_char(ctx, 0, glyph0);
+         lcd1602_define_char(ctx, 1, glyph1);
+         select_write_mode(ctx, mode);
+
+         if(!warm)
+         {
+            ref_reset(&ref);
+            memcpy(&ref.cgram[0], glyph0, GLYPH_SIZE);
+            memcpy(&ref.cgram[GLYPH_SIZE], glyph1, GLYPH_SIZE);
+         }
+         else if(!useSnapshot)
+         {
+            /* Only the display contents are read back */
+            ref.index = 0;
+            ref.shift = 0;
+            ref.increment = true;
+            ref.autoShift = false;
+            ref.control = 0x04;
+         }
+      }
+
+      /* Application time between updates */
+      now_ns += (uint64_t) random_next(2000) * 1000;
+      if(mode->writeBehind && random_next(4) == 0)
+         lcd1602_flush(ctx);
+      if(mode->batchMs > 0 && random_next(100) == 0)
+      {
+         /* Long enough for the pending batch to be sent and for the panel to go idle afterwards */
+         now_ns += (uint64_t) mode->batchMs * 1000000;
+         lcd1602_flush(ctx);
+         now_ns += (uint64_t) POWER_IDLE_MS * 1000000;
+         lcd1602_flush(ctx);
+         if(bus_free > now_ns)
+            now_ns = bus_free;
+         if((panel.control & 0x04) || (panel.output & 0x08))
+         {
+            printf("   panel not idle: display control 0x%x, backlight %s\n", panel.control,
+               (panel.output & 0x08) ? "on" : "off");
+            ++errors;
+         }
+      }
+
+      if((op + 1) % CHECK_INTERVAL == 0 || op + 1 == operations)
+      {
+         /* Disabling write-behind mode sends anything still pending, as does disabling power saving,
+            whether or not it was enabled */
+         if(mode->writeBehind && random_next(4) == 0)
+            lcd1602_set_power_save(ctx, 0, 0);
+         else
+            lcd1602_set_write_behind(ctx, false, 0);
+         errors += compare(&ref, &panel, (verbose) ? DDRAM_SIZE : (0 == errors) ? 10 : 0);
+         if(!(panel.output & 0x08))
+         {
+            printf("   backlight off after flushing\n");
+            ++errors;
+         }
+         select_write_mode(ctx, mode);
+      }
+   }
+
+   if(bus_free > now_ns)
+      now_ns = bus_free;
+   bytesPerOp = (double) (bus_bytes - startBytes) / operations;
+   overBudget = (operations >= BUDGET_MIN_OPERATIONS && bytesPerOp > mode->budget);
+   printf("%-26s %8.2f bytes/op %8.2f transfers/op %7.1f%% bus busy %9.0f ops/s  %s\n", mode->name,
+      bytesPerOp, (double) (bus_transfers - startTransfers) / operations,
+      100.0 * (bus_time - startBusTime) / (now_ns - startTime),
+      operations / ((now_ns - startTime) / 1e9),
+      (0 == errors && 0 == panel.violations && !overBudget
+       && glyphs_replaced <= glyphs_shown) ? "ok" : "FAILED");
+
+   if(errors > 0)
+      printf("   %u cells or registers differ from the reference\n", errors);
+   if(panel.violations > 0)
+      printf("   %u timing or protocol violations\n", panel.violations);
+   if(overBudget)
+      printf("   traffic exceeds the budget of %.2f bytes/op\n", mode->budget);
+   if(verbose)
+      printf("   on-demand glyphs: %u shown, %u fell back\n", glyphs_shown, glyphs_replaced);
+   if(glyphs_replaced > glyphs_shown)
+      printf("   %u of %u on-demand glyphs fell back for lack of CGRAM slots\n", glyphs_replaced,
+         glyphs_shown + glyphs_replaced);
+
+   for(i = 0; i < SCREEN_COUNT; ++i)
+      lcd1602_screen_destroy(screens[i]);
+   lcd1602_log_destroy(log);
+   if(NULL != ctx)
+      lcd1602_deinit(ctx);
+
+   return (0 == errors && 0 == panel.violations && !overBudget
+           && glyphs_replaced <= glyphs_shown) ? 0 : 1;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Urgent writes from one thread while another streams text
+ */
+
+#define THREAD_URGENT_WRITES 200
+#define THREAD_COLUMNS       20   /* of the urgent text, in rows 0 and 2 (DDRAM line 0) */
+/* The library's frame (255 bytes), which is flushed before stepping aside, plus the seek and character
+   that the background writer may have started when the urgent write arrived. A background line takes
+   more than this, so a writer that didn't step aside would exceed it. */
+#define URGENT_MAX_BYTES     (255 + 2 * 12)
+
+typedef struct
+{
+   lcd1602_context ctx;
+   bool writeBehind;
+   bool stop;                              /* accessed atomically */
+   char line[DDRAM_LINE_LENGTH + 1];       /* last text written to DDRAM line 1 (rows 1 and 3) */
+} background_t;
+
+static void *background_writer(void *arg)
+{
+   background_t *b = (background_t *) arg;
+   uint32_t count, i;
+
+   for(count = 0; !__atomic_load_n(&b->stop, __ATOMIC_ACQUIRE); ++count)
+   {
+      for(i = 0; i < DDRAM_LINE_LENGTH; ++i)
+         b->line[i] = (char) ('A' + (count + i) % 26);
+      b->line[DDRAM_LINE_LENGTH] = '\0';
+      lcd1602_set_cursor(b->ctx, 1, 0);
+      lcd1602_string(b->ctx, b->line);
+      if(b->writeBehind)
+         lcd1602_flush(b->ctx);
+   }
+   return NULL;
+}
+
+static int run_threaded(const char *name, bool writeBehind, bool verbose)
+{
+   i2c_lowlevel_config config = {0};
+   background_t background;
+   pthread_t thread;
+   char urgent[2][THREAD_COLUMNS + 1];
+   reference_t ref;
+   uint32_t errors = 0, i;
+
+   now_ns = bus_free = 0;
+   bus_speed = BUS_SPEED;
+   bus_bytes = bus_transfers = bus_time = 0;
+   bus_async = false;
+   model_power_on(&panel);
+   ref_reset(&ref);
+   urgent_state = URGENT_IDLE;
+   urgent_thread = pthread_self();
+   urgent_worst = 0;
+   urgent_delayed = 0;
+
+   memset(&background, 0, sizeof(background));
+   background.ctx = lcd1602_init(LCD1602_I2C_ADDRESS_DEFAULT, true, &config);
+   background.writeBehind = writeBehind;
+   if(NULL == background.ctx)
+   {
+      printf("%s: initialization failed\n", name);
+      return 1;
+   }
+   lcd1602_set_write_behind(background.ctx, writeBehind, 0);
+   if(pthread_create(&thread, NULL, background_writer, &background) != 0)
+   {
+      printf("%s: failed to start the background writer\n", name);
+      lcd1602_deinit(background.ctx);
+      return 1;
+   }
+
+   for(i = 0; i < THREAD_URGENT_WRITES; ++i)
+   {
+      char *text = urgent[i % 2];
+      snprintf(text, THREAD_COLUMNS + 1, "ALARM %-14u", i);
+      pthread_mutex_lock(&clock_mutex);
+      urgent_state = URGENT_ARMED;
+      pthread_mutex_unlock(&clock_mutex);
+      if(lcd1602_write_urgent(background.ctx, 2 * (i % 2), 0, text) != 0)
+      {
+         printf("   urgent write %u failed\n", i);
+         ++errors;
+      }
+      usleep(100); /* real time, for the background writer to get into a string */
+   }
+
+   __atomic_store_n(&background.stop, true, __ATOMIC_RELEASE);
+   pthread_join(thread, NULL);
+   lcd1602_set_write_behind(background.ctx, false, 0);
+
+   for(i = 0; i < DDRAM_LINE_LENGTH; ++i)
+   {
+      ref.ddram[ref_index(0x40 + i)] = (uint8_t) background.line[i];
+      ref.ddram[ref_index(i)] = (uint8_t) urgent[i / THREAD_COLUMNS][i % THREAD_COLUMNS];
+   }
+   errors += compare(&ref, &panel, (verbose) ? DDRAM_SIZE : 10);
+
+   printf("%-26s %8u urgent writes, %u waited, at most %" PRIu64 " bytes ahead    %s\n", name,
+      THREAD_URGENT_WRITES, urgent_delayed, urgent_worst,
+      (0 == errors && 0 == panel.violations && urgent_worst <= URGENT_MAX_BYTES) ? "ok" : "FAILED");
+   if(errors > 0)
+      printf("   %u cells or registers differ from the reference\n", errors);
+   if(panel.violations > 0)
+      printf("   %u timing or protocol violations\n", panel.violations);
+   if(urgent_worst > URGENT_MAX_BYTES)
+      printf("   an urgent write waited for %" PRIu64 " bytes, more than the %u allowed\n", urgent_worst,
+         URGENT_MAX_BYTES);
+
+   lcd1602_deinit(background.ctx);
+   return (0 == errors && 0 == panel.violations && urgent_worst <= URGENT_MAX_BYTES) ? 0 : 1;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Flush scheduling
+ */
+
+#define NEXT_FLUSH_FPS 20
+
+static uint32_t check_next_flush(lcd1602_context ctx, const char *when, uint32_t low, uint32_t high)
+{
+   uint32_t next = lcd1602_next_flush(ctx);
+   if(next >= low && next <= high)
+      return 0;
+   printf("   %s: next flush in %u us, expected %u to %u\n", when, next, low, high);
+   return 1;
+}
+
+static int run_next_flush(bool verbose)
+{
+   i2c_lowlevel_config config = {0};
+   lcd1602_context ctx;
+   reference_t ref;
+   uint32_t errors = 0;
+
+   now_ns = bus_free = 0;
+   bus_speed = BUS_SPEED;
+   bus_bytes = bus_transfers = bus_time = 0;
+   bus_async = false;
+   model_power_on(&panel);
+   ref_reset(&ref);
+
+   ctx = lcd1602_init(LCD1602_I2C_ADDRESS_DEFAULT, true, &config);
+   if(NULL == ctx)
+   {
+      printf("next flush: initialization failed\n");
+      return 1;
+   }
+
+   /* The first change after enabling write-behind is due at once */
+   lcd1602_set_write_behind(ctx, true, NEXT_FLUSH_FPS);
+   errors += check_next_flush(ctx, "nothing changed", LCD1602_NEXT_FLUSH_NONE, LCD1602_NEXT_FLUSH_NONE);
+   lcd1602_string(ctx, "A");
+   errors += check_next_flush(ctx, "first change", 0, 0);
+   lcd1602_flush(ctx);
+   errors += check_next_flush(ctx, "first flush", LCD1602_NEXT_FLUSH_NONE, LCD1602_NEXT_FLUSH_NONE);
+
+   /* Later ones wait for the frame interval */
+   lcd1602_string(ctx, "B");
+   errors += check_next_flush(ctx, "second change", 1, 1000000 / NEXT_FLUSH_FPS);
+   sys_delay_us(1000000 / NEXT_FLUSH_FPS);
+   errors += check_next_flush(ctx, "frame interval passed", 0, 0);
+   lcd1602_flush(ctx);
+
+   ref.ddram[ref_index(0)] = 'A';
+   ref.ddram[ref_index(1)] = 'B';
+   errors += compare(&ref, &panel, (verbose) ? DDRAM_SIZE : 10);
+
+   printf("%-26s %s\n", "next flush", (0 == errors && 0 == panel.violations) ? "ok" : "FAILED");
+   if(panel.violations > 0)
+      printf("   %u timing or protocol violations\n", panel.violations);
+
+   lcd1602_deinit(ctx);
+   return (0 == errors && 0 == panel.violations) ? 0 : 1;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Transports opened without a configuration
+ */
+
+static int run_missing_config(void)
+{
+   const lcd1602_transport *transports[] = { &lcd1602_transport_i2cdev, &lcd1602_transport_virtual };
+   lcd1602_context ctx;
+   uint32_t errors = 0, i;
+
+   for(i = 0; i < sizeof(transports) / sizeof(transports[0]); ++i)
+   {
+      ctx = lcd1602_init_transport(LCD1602_I2C_ADDRESS_DEFAULT, true, transports[i], NULL);
+      if(NULL == ctx)
+         continue;
+      printf("   the %s transport opened without a configuration\n", transports[i]->name);
+      lcd1602_deinit(ctx);
+      ++errors;
+   }
+
+   printf("%-26s %s\n", "missing configuration", (0 == errors) ? "ok" : "FAILED");
+   return (0 == errors) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+   uint32_t operations = 10000, seed = 1, m;
+   bool verbose = false;
+   int option, failures = 0;
+
+   while((option = getopt(argc, argv, "n:s:v")) != -1)
+   {
+      switch(option)
+      {
+         case 'n':
+            operations = strtoul(optarg, NULL, 0);
+            break;
+         case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+         case 'v':
+            verbose = true;
+            break;
+         default:
+            MSG("Usage: %s [-n operations] [-s seed] [-v]\n", argv[0]);
+            return -1;
+      }
+   }
+   if(0 == operations)
+      operations = 1;
+
+   printf("%u operations, seed %u\n", operations, seed);
+   for(m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+      failures += run(&modes[m], seed, operations, verbose);
+   failures += run_threaded("threaded urgent, direct", false, verbose);
+   failures += run_threaded("threaded urgent, w-behind", true, verbose);
+   failures += run_next_flush(verbose);
+   failures += run_missing_config();
+
+   return (0 == failures) ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Prints what a virtual lcd1602 panel shows, from another process
+ *
+ * Usage: lcd1602_view [-r rows] [-c columns] [-i interval_ms] /name
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lcd1602/lcd1602_virtual.h"
+
+#define MSG(...) fprintf(stderr, __VA_ARGS__)
+
+int main(int argc, char *argv[])
+{
+   const lcd1602_virtual_panel *panel;
+   lcd1602_virtual_panel copy;
+   char text[LCD1602_VIRTUAL_LINE_LENGTH + 1];
+   int option, rows = 2, columns = 16, interval = 0;
+   uint16_t row;
+
+   while((option = getopt(argc, argv, "r:c:i:")) != -1)
+   {
+      switch(option)
+      {
+         case 'r':
+            rows = atoi(optarg);
+            break;
+         case 'c':
+            columns = atoi(optarg);
+            break;
+         case 'i':
+            interval = atoi(optarg);
+            break;
+         default:
+            optind = argc; /* print usage */
+            break;
+      }
+   }
+   if(optind != argc - 1 || rows < 1 || rows > 4 || columns < 1 || columns > LCD1602_VIRTUAL_LINE_LENGTH)
+   {
+      MSG("Usage: %s [-r rows] [-c columns] [-i interval_ms] /name\n", argv[0]);
+      return -1;
+   }
+
+   panel = lcd1602_virtual_open(argv[optind]);
+   if(NULL == panel)
+   {
+      MSG("No virtual panel named '%s'\n", argv[optind]);
+      return -1;
+   }
+
+   do
+   {
+      lcd1602_virtual_read(panel, &copy);
+      for(row = 0; row < rows; ++row)
+      {
+         uint16_t column;
+         lcd1602_virtual_row(&copy, row, columns, text);
+         for(column = 0; column < columns; ++column)
+            text[column] = (text[column] < ' ' || text[column] > '~') ? '#' : text[column];
+         printf("|%s|\n", text);
+      }
+      printf("%llu bytes, %llu transfers, %llu instructions, %llu violations\n",
+         (unsigned long long) copy.bytes, (unsigned long long) copy.transfers,
+         (unsigned long long) copy.instructions, (unsigned long long) copy.violations);
+      if(interval > 0)
+         usleep(interval * 1000);
+   } while(interval > 0);
+
+   lcd1602_virtual_close(panel);
+   return 0;
+}
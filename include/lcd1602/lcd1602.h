@@ -32,6 +32,41 @@ typedef void *lcd1602_context;
 lcd1602_context lcd1602_init(uint8_t i2cAddress, bool backlightOn, i2c_lowlevel_config *config);
 void lcd1602_deinit(lcd1602_context context);
 
+/* ----------------------------------------------------------------
+ * Warm attach
+ *
+ * lcd1602_init_warm() takes over a panel that is already powered and
+ * initialized (e.g. when a service restarts) without the power-on delays
+ * and without clearing the display. The controller is brought back in
+ * step with a short resynchronization sequence that is safe even if the
+ * previous owner stopped half-way through a byte. If "snapshot" is NULL,
+ * the display contents are read back from the panel; otherwise the panel
+ * is assumed to still hold the snapshot, which is both faster and also
+ * restores the cursor, display mode and custom characters. Save a snapshot
+ * with lcd1602_get_snapshot() before exiting, after any pending
+ * write-behind changes have been flushed. If the panel doesn't respond as
+ * expected, lcd1602_init_warm() falls back to a full reset.
+ */
+
+#define LCD1602_SNAPSHOT_VERSION 1
+
+typedef struct
+{
+   uint32_t version;       /* LCD1602_SNAPSHOT_VERSION */
+   uint8_t ddram[80];      /* both display data lines, 40 characters each */
+   uint8_t cgram[64];      /* custom character bitmaps */
+   uint8_t glyphs;         /* bit per custom character whose bitmap is valid */
+   uint8_t address;
+   uint8_t cgramSelected;
+   uint8_t entryMode;
+   uint8_t displayControl;
+   uint8_t displayShift;
+} lcd1602_snapshot;
+
+lcd1602_context lcd1602_init_warm(uint8_t i2cAddress, bool backlightOn, i2c_lowlevel_config *config,
+   const lcd1602_snapshot *snapshot);
+int lcd1602_get_snapshot(lcd1602_context context, lcd1602_snapshot *snapshot);
+
 /* ----------------------------------------------------------------
  * Functions 
  */
@@ -63,6 +98,240 @@ int lcd1602_scroll(lcd1602_context context, eLCD1602ScrollTarget target,
 int lcd1602_char(lcd1602_context context, char c);
 int lcd1602_string(lcd1602_context context, char *s);
 
+/* ----------------------------------------------------------------
+ * Custom characters and rendering
+ *
+ * The controller has LCD1602_CGRAM_SLOTS user-definable characters
+ * (character codes 0 to 7). Slots passed to lcd1602_define_char() belong
+ * to the application; the remaining slots are shared by the renderers
+ * below, which load glyphs on demand and reuse any that are already
+ * loaded. Renderers only send the cells that changed, so updating a bar
+ * graph or a large number usually costs one or two bytes.
+ */
+
+#define LCD1602_CGRAM_SLOTS 8
+
+/* bitmap is 8 rows of 5 pixels, most significant pixel on the left (bit 4) */
+int lcd1602_define_char(lcd1602_context context, uint8_t slot, const uint8_t *bitmap);
+
+/* Horizontal bar of "width" cells, filled in proportion to value/maximum with
+   single-pixel-column resolution */
+int lcd1602_bar(lcd1602_context context, uint16_t row, uint16_t column, uint16_t width,
+   uint32_t value, uint32_t maximum);
+
+/* Large characters, 2 or 4 rows tall and 3 columns wide, separated by a blank
+   column. Supports digits, space and '-'. */
+int lcd1602_big_string(lcd1602_context context, uint16_t row, uint16_t column, uint16_t height,
+   const char *s);
+
+/* ----------------------------------------------------------------
+ * UTF-8 text
+ *
+ * lcd1602_string_utf8() translates UTF-8 text to the character ROM fitted
+ * to the panel (A00 unless changed with lcd1602_set_charset()). Characters
+ * the ROM lacks are drawn with a custom character when the library has a
+ * glyph for them and a CGRAM slot is available, and as '?' otherwise.
+ * Malformed sequences, including overlong encodings and surrogates, are
+ * also shown as '?'.
+ */
+
+typedef enum
+{
+   LCD1602_CHARSET_A00, /* Japanese standard font (most common) */
+   LCD1602_CHARSET_A02, /* European standard font */
+} eLCD1602Charset;
+
+int lcd1602_set_charset(lcd1602_context context, eLCD1602Charset charset);
+int lcd1602_string_utf8(lcd1602_context context, const char *s);
+
+/* ----------------------------------------------------------------
+ * Screens
+ *
+ * A screen is an off-screen page of text. Showing a screen only sends the
+ * cells that differ from what's currently displayed, so switching between
+ * precomposed screens never needs lcd1602_clear(). Screens with 1 or 2 rows
+ * may be up to 40 columns wide (the controller's full line length); the
+ * "column" passed to lcd1602_screen_show() selects the leftmost visible
+ * column using the controller's display shift, so paging horizontally
+ * through a wide screen doesn't rewrite any cells.
+ */
+
+typedef void *lcd1602_screen;
+
+lcd1602_screen lcd1602_screen_create(uint16_t rows, uint16_t columns);
+void lcd1602_screen_destroy(lcd1602_screen screen);
+int lcd1602_screen_clear(lcd1602_screen screen);
+int lcd1602_screen_string(lcd1602_screen screen, uint16_t row, uint16_t column, const char *s);
+int lcd1602_screen_show(lcd1602_context context, lcd1602_screen screen, uint16_t column);
+
+/* ----------------------------------------------------------------
+ * Log views
+ *
+ * A log view shows the newest lines of a ring buffer in a block of
+ * rows, with each appended line pushing the older ones up. Showing the
+ * view only sends the cells that differ from what's displayed, so a
+ * scroll costs far less than rewriting the block. lcd1602_log_show()
+ * renders at most "maxFps" times per second (0 for no limit); lines
+ * appended in between are shown together by a later call, so call it
+ * after appending and periodically. Lines longer than the view can be
+ * scrolled horizontally with lcd1602_log_set_offset().
+ */
+
+#define LCD1602_LOG_LINE_LENGTH 64 /* longer lines are truncated */
+
+typedef void *lcd1602_log;
+
+lcd1602_log lcd1602_log_create(uint16_t row, uint16_t rows, uint16_t columns, uint16_t history,
+   uint32_t maxFps);
+void lcd1602_log_destroy(lcd1602_log log);
+int lcd1602_log_append(lcd1602_log log, const char *line);
+int lcd1602_log_set_offset(lcd1602_log log, uint16_t column);
+int lcd1602_log_show(lcd1602_context context, lcd1602_log log);
+
+/* ----------------------------------------------------------------
+ * Write-behind mode
+ *
+ * When enabled, the functions above only update the library's copy of the
+ * display state. lcd1602_flush() then sends whatever differs from what the
+ * panel currently shows, at most maxFps times per second (0 for no limit);
+ * calls made sooner return immediately without touching the bus. Call
+ * lcd1602_flush() periodically (e.g. from the application's main loop).
+ * Disabling write-behind mode flushes any pending changes.
+ */
+
+int lcd1602_set_write_behind(lcd1602_context context, bool enable, uint32_t maxFps);
+int lcd1602_flush(lcd1602_context context);
+
+/* ----------------------------------------------------------------
+ * Power saving
+ *
+ * lcd1602_set_power_save() selects write-behind mode in which changes are
+ * collected for batchWindowMs from the first one, then sent by
+ * lcd1602_flush() in a single burst, so that the i2c peripheral is woken
+ * once per batch rather than once per call. After idleTimeoutMs without
+ * changes (0 for never), lcd1602_flush() switches the display and the
+ * backlight off; the next change sent or urgent write switches them back
+ * on. Passing 0 for both sends any pending changes and disables power
+ * saving, returning to write-behind mode if it was enabled with
+ * lcd1602_set_write_behind() beforehand, or to direct writes otherwise.
+ * Calling lcd1602_set_write_behind() also disables power saving.
+ *
+ * lcd1602_next_flush() returns the microseconds until lcd1602_flush() has
+ * something to do, or LCD1602_NEXT_FLUSH_NONE if nothing is scheduled, so
+ * that the application can sleep until then.
+ */
+
+#define LCD1602_NEXT_FLUSH_NONE UINT32_MAX
+
+int lcd1602_set_power_save(lcd1602_context context, uint32_t batchWindowMs, uint32_t idleTimeoutMs);
+uint32_t lcd1602_next_flush(lcd1602_context context);
+
+/* ----------------------------------------------------------------
+ * Urgent updates
+ *
+ * lcd1602_write_urgent() is for text that must not wait, such as an
+ * alarm banner. It writes the text at the given cell straight to the
+ * panel, even in write-behind mode, without moving the cursor used by
+ * the other functions. Long-running updates in other tasks (strings,
+ * screens, renderers and write-behind frames) step aside between
+ * instructions while an urgent write is waiting, so it is delayed by at
+ * most the bytes they have already queued. Cells they had yet to send
+ * and that the urgent write has since replaced are never sent.
+ */
+
+int lcd1602_write_urgent(lcd1602_context context, uint16_t row, uint16_t column, const char *s);
+
+/* ----------------------------------------------------------------
+ * Timing
+ *
+ * By default the library uses the bus speed and instruction delays that
+ * every HD44780 and PCF8574 is specified to handle. lcd1602_calibrate()
+ * finds the fastest profile a particular panel handles reliably: it tries
+ * faster bus speeds and shorter delays, reading each result back from the
+ * panel (which must support reads) to confirm it, then applies the result
+ * with a safety margin. The display is redrawn afterwards. Store the
+ * resulting profile and restore it with lcd1602_set_timing() on later
+ * runs. If a transfer fails while a faster profile is in use, the library
+ * falls back to the default profile. Where the bus speed can't be changed
+ * (e.g. Linux i2c-dev), calibration keeps the current speed, and
+ * lcd1602_set_timing() fails for a profile with a different one.
+ */
+
+typedef struct
+{
+   uint32_t busSpeed; /* hz */
+   uint32_t settle;   /* microseconds for most instructions to execute */
+   uint32_t clear;    /* microseconds for clear and return home */
+   uint32_t modeSet;  /* microseconds after entry mode set and display control */
+} lcd1602_timing;
+
+int lcd1602_get_timing(lcd1602_context context, lcd1602_timing *timing);
+int lcd1602_set_timing(lcd1602_context context, const lcd1602_timing *timing);
+int lcd1602_calibrate(lcd1602_context context, lcd1602_timing *timing);
+
+/* ----------------------------------------------------------------
+ * Transports
+ *
+ * lcd1602_init() reaches the PCF8574 through the platform's i2c_ll_*
+ * functions, which are chosen when the application is linked.
+ * lcd1602_init_transport() selects a transport at run time instead, per
+ * context, so that one program can drive panels on different kinds of
+ * adapters (e.g. a USB-I2C bridge next to an on-board bus). open()
+ * returns the handle passed to the other functions and fills in the
+ * transport's capabilities, which decide how the library talks to it:
+ * frames longer than maxWrite are split into several writes, reads (used
+ * by lcd1602_init_warm() and lcd1602_calibrate()) fail at once unless
+ * "read" is set, and with "vectored" each status or data read is a single
+ * transfer() call instead of five separate transfers. set_speed may be
+ * NULL if the adapter's clock can't be changed; the library then spaces
+ * instructions for the fastest bus the adapter might run (1 MHz).
+ * lcd1602_init_warm_transport() is the warm attach of lcd1602_init_warm()
+ * over a transport.
+ *
+ * On Linux, lcd1602_transport_i2cdev talks to the i2c-dev interface and
+ * falls back to SMBus transfers on adapters without plain i2c support,
+ * such as the kernel's i2c-stub module. lcd1602_transport_virtual is the
+ * simulated panel described in lcd1602_virtual.h. Both take an
+ * i2c_lowlevel_config.
+ */
+
+typedef struct
+{
+   uint8_t *data;
+   uint16_t length;
+   bool read;          /* data is filled in by the device */
+} lcd1602_transport_segment;
+
+typedef struct
+{
+   uint16_t maxWrite;  /* bytes per write(), at least 1 */
+   bool read;          /* read() is supported */
+   bool vectored;      /* transfer() is supported */
+} lcd1602_transport_caps;
+
+typedef struct
+{
+   const char *name;
+   void *(*open)(const void *config, uint8_t i2cAddress, uint32_t busSpeed, uint32_t timeoutMs,
+                 lcd1602_transport_caps *caps);
+   void (*close)(void *handle);
+   bool (*write)(void *handle, const uint8_t *data, uint16_t length);
+   bool (*read)(void *handle, uint8_t *data, uint16_t length);
+   bool (*transfer)(void *handle, const lcd1602_transport_segment *segments, uint16_t count);
+   bool (*set_speed)(void *handle, uint32_t busSpeed);
+} lcd1602_transport;
+
+extern const lcd1602_transport lcd1602_transport_sys; /* the i2c_ll_* functions, as used by lcd1602_init() */
+#if defined(__linux__)
+extern const lcd1602_transport lcd1602_transport_i2cdev;
+extern const lcd1602_transport lcd1602_transport_virtual;
+#endif
+
+lcd1602_context lcd1602_init_transport(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config);
+lcd1602_context lcd1602_init_warm_transport(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config, const lcd1602_snapshot *snapshot);
+
 #ifdef __cplusplus
 }
 #endif
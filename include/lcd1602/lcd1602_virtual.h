@@ -0,0 +1,108 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 virtual panel interface (Linux)
+ *
+ * Setting i2c_lowlevel_config.device to "virtual" replaces the i2c bus with a simulated PCF8574 and
+ * HD44780, so that applications can run without hardware. With "virtual:/name", the simulated panel
+ * is also published as POSIX shared memory "/name", which other processes can map with
+ * lcd1602_virtual_open() to inspect what the panel shows.
+ */
+#ifndef LCD1602_VIRTUAL_H
+#define LCD1602_VIRTUAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>    /* O_* */
+#include <unistd.h>   /* close */
+#include <sys/mman.h> /* shm_open, mmap */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCD1602_VIRTUAL_MAGIC        0x4c434456 /* "LCDV" */
+#define LCD1602_VIRTUAL_VERSION      1
+#define LCD1602_VIRTUAL_LINE_LENGTH  40
+
+/* The panel's registers and memory, updated after every transfer. The sequence counter is odd while
+   an update is in progress. */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t sequence;
+   uint8_t ddram[128];      /* by DDRAM address: 0x00-0x27 is line 1, 0x40-0x67 is line 2 */
+   uint8_t cgram[64];
+   uint8_t address;         /* address counter */
+   uint8_t cgramSelected;
+   uint8_t entryMode;       /* flags of the last entry mode set instruction */
+   uint8_t displayControl;  /* flags of the last display control instruction */
+   uint8_t displayShift;    /* columns the display is shifted left */
+   uint8_t backlight;
+   uint8_t reserved[2];
+   uint64_t bytes;          /* PCF8574 bytes received */
+   uint64_t transfers;      /* i2c transfers received */
+   uint64_t instructions;   /* instructions and data writes executed */
+   uint64_t violations;     /* writes ignored because the controller was busy, or too-short pulses */
+} lcd1602_virtual_panel;
+
+/* Maps the panel published with the given shared-memory name, read-only */
+static inline const lcd1602_virtual_panel *lcd1602_virtual_open(const char *name)
+{
+   lcd1602_virtual_panel *panel;
+   int fd = shm_open(name, O_RDONLY, 0);
+   if(fd < 0)
+      return NULL;
+   panel = (lcd1602_virtual_panel *) mmap(NULL, sizeof(*panel), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(MAP_FAILED == panel)
+      return NULL;
+   if(panel->magic != LCD1602_VIRTUAL_MAGIC || panel->version != LCD1602_VIRTUAL_VERSION)
+   {
+      munmap(panel, sizeof(*panel));
+      return NULL;
+   }
+   return panel;
+}
+
+static inline void lcd1602_virtual_close(const lcd1602_virtual_panel *panel)
+{
+   munmap((void *) panel, sizeof(*panel));
+}
+
+/* Copies a consistent snapshot of the panel, waiting for an update in progress to finish */
+static inline void lcd1602_virtual_read(const lcd1602_virtual_panel *panel, lcd1602_virtual_panel *copy)
+{
+   uint32_t before, after;
+   do
+   {
+      before = __atomic_load_n(&panel->sequence, __ATOMIC_ACQUIRE);
+      memcpy(copy, (const void *) panel, sizeof(*copy));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      after = __atomic_load_n(&panel->sequence, __ATOMIC_RELAXED);
+   } while((before & 1) || before != after);
+}
+
+/* Fills "text" with the character codes visible in one row of a panel "columns" wide, taking the
+   display shift into account. "text" must hold columns + 1 characters. Rows 2 and 3 of 4-row panels
+   continue lines 1 and 2 from column 20. */
+static inline void lcd1602_virtual_row(const lcd1602_virtual_panel *panel, uint16_t row, uint16_t columns,
+   char *text)
+{
+   uint8_t line = (row & 1) ? 0x40 : 0x00;
+   uint16_t start = (row >= 2) ? 20 : 0, column;
+
+   for(column = 0; column < columns; ++column)
+   {
+      uint16_t position = (start + column + panel->displayShift) % LCD1602_VIRTUAL_LINE_LENGTH;
+      text[column] = (char) panel->ddram[line | position];
+   }
+   text[columns] = '\0';
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCD1602_VIRTUAL_H */
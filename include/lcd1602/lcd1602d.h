@@ -0,0 +1,97 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602d shared-memory framebuffer interface (Linux)
+ *
+ * The lcd1602d daemon owns one or more panels and publishes a POSIX shared-memory framebuffer for
+ * each of them. Any number of processes may map a framebuffer and write text into it with plain
+ * memory stores; the daemon sends the changes to the panel. Clients never touch the i2c bus.
+ */
+#ifndef LCD1602D_H
+#define LCD1602D_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>    /* O_* */
+#include <unistd.h>   /* close */
+#include <sys/mman.h> /* shm_open, mmap */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCD1602D_MAGIC      0x4c434431 /* "LCD1" */
+#define LCD1602D_VERSION    1
+#define LCD1602D_ROWS       4
+#define LCD1602D_COLUMNS    40
+
+/* Each row is an independent region with its own sequence counter. The counter is odd while a client
+   is writing the row; the daemon only copies a row when its counter is even and unchanged across the
+   copy. */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint16_t rows;    /* panel size, set by the daemon */
+   uint16_t columns;
+   uint32_t sequence[LCD1602D_ROWS];
+   uint8_t cells[LCD1602D_ROWS][LCD1602D_COLUMNS];
+} lcd1602d_framebuffer;
+
+/* Maps the framebuffer with the given shared-memory name (printed by lcd1602d at startup) */
+static inline lcd1602d_framebuffer *lcd1602d_open(const char *name)
+{
+   lcd1602d_framebuffer *fb;
+   int fd = shm_open(name, O_RDWR, 0);
+   if(fd < 0)
+      return NULL;
+   fb = (lcd1602d_framebuffer *) mmap(NULL, sizeof(*fb), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if(MAP_FAILED == fb)
+      return NULL;
+   if(fb->magic != LCD1602D_MAGIC || fb->version != LCD1602D_VERSION
+   || fb->rows > LCD1602D_ROWS || fb->columns > LCD1602D_COLUMNS)
+   {
+      munmap(fb, sizeof(*fb));
+      return NULL;
+   }
+   return fb;
+}
+
+static inline void lcd1602d_close(lcd1602d_framebuffer *fb)
+{
+   munmap(fb, sizeof(*fb));
+}
+
+/* Writes a string into one row, starting at "column". Concurrent writers of the same row are
+   serialized; writers of different rows never wait for each other. */
+static inline bool lcd1602d_write(lcd1602d_framebuffer *fb, uint16_t row, uint16_t column, const char *s)
+{
+   uint16_t rows = __atomic_load_n(&fb->rows, __ATOMIC_RELAXED);
+   uint16_t columns = __atomic_load_n(&fb->columns, __ATOMIC_RELAXED);
+   uint32_t sequence;
+
+   /* The size is shared memory too; a corrupt one must not move writes outside the framebuffer */
+   if(rows > LCD1602D_ROWS || columns > LCD1602D_COLUMNS || row >= rows || column >= columns)
+      return false;
+
+   do
+   {
+      sequence = __atomic_load_n(&fb->sequence[row], __ATOMIC_RELAXED);
+   } while((sequence & 1)
+        || !__atomic_compare_exchange_n(&fb->sequence[row], &sequence, sequence + 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+   __atomic_thread_fence(__ATOMIC_RELEASE); /* odd sequence is visible before any cell changes */
+
+   for(; column < columns && *s != '\0'; ++column, ++s)
+      fb->cells[row][column] = (uint8_t) *s;
+
+   __atomic_store_n(&fb->sequence[row], sequence + 2, __ATOMIC_RELEASE);
+   return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCD1602D_H */
@@ -21,6 +21,11 @@ typedef struct i2c_lowlevel_s
    i2c_port_t port;
    int pin_sda;
    int pin_scl;
+
+   /* If bus != NULL and the bus was created with a non-zero trans_queue_depth,
+      set this to the same value to allow asynchronous transfers. When the
+      library creates the bus itself, asynchronous transfers are always used. */
+   uint32_t trans_queue_depth;
 } i2c_lowlevel_config;
 
 #endif /* _SYS_ESP_IDF_H */
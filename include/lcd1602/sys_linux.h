@@ -6,11 +6,18 @@
 #define _SYS_LINUX_H
 
 #include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 typedef struct
 {
    /* Note that it may be necessary to access i2c device files as root */
-   const char *device;   /* e.g. "/dev/i2c-0" */
+   const char *device;   /* e.g. "/dev/i2c-0", or "virtual" for a simulated panel (see lcd1602_virtual.h) */
+
+   /* Simulated panel only */
+   uint32_t virtual_bus_speed;    /* hz; 0 follows the speed the library selects */
+   uint32_t virtual_exec_percent; /* controller execution times, in percent of the datasheet's; 0 is 100 */
+   bool virtual_zero_latency;     /* transfers take no time and the controller is never busy */
 } i2c_lowlevel_config;
 
 #endif /* _SYS_LINUX_H */
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 UTF-8 to character ROM translation
+ */
+#include <stddef.h>
+#include "lcd1602_private.h"
+#include "charset_tables.h"
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Flat tables for U+0000-U+00FF, one per ROM, generated by the preprocessor. Each entry is a constant
+ * expression that searches LCD1602_CHARSET_MAP, so nothing is computed at runtime.
+ */
+
+#define CHARSET_DEFAULT_A00(cp) (((cp) >= 0x20 && (cp) <= 0x7d) ? (cp) : 0)
+#define CHARSET_DEFAULT_A02(cp) ((((cp) >= 0x20 && (cp) <= 0x7e) || (cp) >= 0xa0) ? (cp) : 0)
+
+#define CHARSET_MATCH_A00(cp, point, a00, a02) ((cp) == (point)) ? (a00) :
+#define CHARSET_MATCH_A02(cp, point, a00, a02) ((cp) == (point)) ? (a02) :
+#define CHARSET_A00(cp) (LCD1602_CHARSET_MAP(CHARSET_MATCH_A00, cp) CHARSET_DEFAULT_A00(cp))
+#define CHARSET_A02(cp) (LCD1602_CHARSET_MAP(CHARSET_MATCH_A02, cp) CHARSET_DEFAULT_A02(cp))
+
+#define CHARSET_ROW(f, base) \
+   f((base) + 0x0), f((base) + 0x1), f((base) + 0x2), f((base) + 0x3), \
+   f((base) + 0x4), f((base) + 0x5), f((base) + 0x6), f((base) + 0x7), \
+   f((base) + 0x8), f((base) + 0x9), f((base) + 0xa), f((base) + 0xb), \
+   f((base) + 0xc), f((base) + 0xd), f((base) + 0xe), f((base) + 0xf)
+#define CHARSET_TABLE(f) { \
+   CHARSET_ROW(f, 0x00), CHARSET_ROW(f, 0x10), CHARSET_ROW(f, 0x20), CHARSET_ROW(f, 0x30), \
+   CHARSET_ROW(f, 0x40), CHARSET_ROW(f, 0x50), CHARSET_ROW(f, 0x60), CHARSET_ROW(f, 0x70), \
+   CHARSET_ROW(f, 0x80), CHARSET_ROW(f, 0x90), CHARSET_ROW(f, 0xa0), CHARSET_ROW(f, 0xb0), \
+   CHARSET_ROW(f, 0xc0), CHARSET_ROW(f, 0xd0), CHARSET_ROW(f, 0xe0), CHARSET_ROW(f, 0xf0) }
+
+static const uint8_t charset_latin1[LCD1602_CHARSET_COUNT][256] = {
+   CHARSET_TABLE(CHARSET_A00),
+   CHARSET_TABLE(CHARSET_A02),
+};
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Sorted tables for everything else, searched by code point
+ */
+
+typedef struct
+{
+   uint16_t codepoint;
+   uint8_t code[LCD1602_CHARSET_COUNT];
+} charset_entry_t;
+
+typedef struct
+{
+   uint16_t codepoint;
+   uint8_t bitmap[LCD1602_GLYPH_SIZE];
+} charset_glyph_t;
+
+#define CHARSET_ENTRY(arg, point, a00, a02) { point, { a00, a02 } },
+#define CHARSET_GLYPH(point, r0, r1, r2, r3, r4, r5, r6, r7) { point, { r0, r1, r2, r3, r4, r5, r6, r7 } },
+
+static const charset_entry_t charset_map[] = { LCD1602_CHARSET_MAP(CHARSET_ENTRY, 0) };
+static const charset_glyph_t charset_glyphs[] = { LCD1602_CHARSET_GLYPHS(CHARSET_GLYPH) };
+
+#define CHARSET_FIND(table, cp, result) do { \
+   size_t low = 0, high = sizeof(table) / sizeof(table[0]); \
+   result = NULL; \
+   while(low < high) { \
+      size_t mid = (low + high) / 2; \
+      if(table[mid].codepoint == (cp)) { result = &table[mid]; break; } \
+      if(table[mid].codepoint < (cp)) low = mid + 1; else high = mid; \
+   } \
+} while(0)
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Internal Functions
+ */
+
+/* Returns the ROM character code for a code point, or -1 if the ROM doesn't have one */
+int lcd1602_charset_code(eLCD1602Charset charset, uint32_t codepoint)
+{
+   const charset_entry_t *entry;
+   uint8_t code;
+
+   if(codepoint < 0x100)
+      code = charset_latin1[charset][codepoint];
+   else
+   {
+      CHARSET_FIND(charset_map, codepoint, entry);
+      code = (NULL == entry) ? 0 : entry->code[charset];
+   }
+   return (0 == code) ? -1 : code;
+}
+
+/* Returns a CGRAM bitmap for a code point, or NULL if there isn't one */
+const uint8_t *lcd1602_charset_glyph(uint32_t codepoint)
+{
+   const charset_glyph_t *glyph;
+   CHARSET_FIND(charset_glyphs, codepoint, glyph);
+   return (NULL == glyph) ? NULL : glyph->bitmap;
+}
+
+/* Decodes the next UTF-8 sequence and advances *s past it. Malformed input yields
+   LCD1602_UTF8_INVALID and consumes at least one byte; a terminating NUL is never consumed
+   as part of a sequence. Overlong encodings, surrogates and code points beyond U+10FFFF are
+   malformed, and consume their whole sequence. */
+uint32_t lcd1602_utf8_decode(const char **s)
+{
+   static const uint32_t minimum[] = { 0, 0x80, 0x800, 0x10000 }; /* by continuation bytes */
+   const uint8_t *p = (const uint8_t *) *s;
+   uint32_t codepoint;
+   int extra, i;
+
+   if(p[0] < 0x80)
+   {
+      codepoint = p[0];
+      extra = 0;
+   }
+   else if((p[0] & 0xe0) == 0xc0)
+   {
+      codepoint = p[0] & 0x1f;
+      extra = 1;
+   }
+   else if((p[0] & 0xf0) == 0xe0)
+   {
+      codepoint = p[0] & 0x0f;
+      extra = 2;
+   }
+   else if((p[0] & 0xf8) == 0xf0)
+   {
+      codepoint = p[0] & 0x07;
+      extra = 3;
+   }
+   else
+   {
+      *s += 1;
+      return LCD1602_UTF8_INVALID;
+   }
+
+   for(i = 1; i <= extra; ++i)
+   {
+      if((p[i] & 0xc0) != 0x80)
+      {
+         *s += i;
+         return LCD1602_UTF8_INVALID;
+      }
+      codepoint = (codepoint << 6) | (p[i] & 0x3f);
+   }
+
+   *s += extra + 1;
+   if(codepoint < minimum[extra] || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff))
+      return LCD1602_UTF8_INVALID;
+   return codepoint;
+}
@@ -0,0 +1,62 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 character ROM translation tables
+ *
+ * These lists are expanded by charset.c into flat lookup arrays at compile time. Both lists must be
+ * sorted by code point.
+ */
+#ifndef LCD1602_CHARSET_TABLES_H
+#define LCD1602_CHARSET_TABLES_H
+
+/* X(arg, code point, A00 ROM code, A02 ROM code)
+ * 0 means the ROM has no equivalent character. Printable ASCII that isn't listed is shown unchanged by
+ * both ROMs, as is U+00A0-U+00FF on the (Latin-1 based) A02 ROM. */
+#define LCD1602_CHARSET_MAP(X, arg) \
+   X(arg, 0x005c, 0x00, 0x5c) /* \ (A00 shows a yen sign) */ \
+   X(arg, 0x007e, 0x00, 0x7e) /* ~ (A00 shows a right arrow) */ \
+   X(arg, 0x00a0, 0x20, 0xa0) /* no-break space */ \
+   X(arg, 0x00a2, 0xec, 0xa2) /* cent sign */ \
+   X(arg, 0x00a5, 0x5c, 0xa5) /* yen sign */ \
+   X(arg, 0x00b0, 0xdf, 0xb0) /* degree sign */ \
+   X(arg, 0x00b5, 0xe4, 0xb5) /* micro sign */ \
+   X(arg, 0x00b7, 0xa5, 0xb7) /* middle dot */ \
+   X(arg, 0x00df, 0xe2, 0xdf) /* sharp s */ \
+   X(arg, 0x00e4, 0xe1, 0xe4) /* a diaeresis */ \
+   X(arg, 0x00f1, 0xee, 0xf1) /* n tilde */ \
+   X(arg, 0x00f6, 0xef, 0xf6) /* o diaeresis */ \
+   X(arg, 0x00f7, 0xfd, 0xf7) /* division sign */ \
+   X(arg, 0x00fc, 0xf5, 0xfc) /* u diaeresis */ \
+   X(arg, 0x03a3, 0xf6, 0x00) /* capital sigma */ \
+   X(arg, 0x03a9, 0xf4, 0x00) /* capital omega */ \
+   X(arg, 0x03b1, 0xe0, 0x00) /* alpha */ \
+   X(arg, 0x03b2, 0xe2, 0x00) /* beta */ \
+   X(arg, 0x03b5, 0xe3, 0x00) /* epsilon */ \
+   X(arg, 0x03b8, 0xf2, 0x00) /* theta */ \
+   X(arg, 0x03bc, 0xe4, 0xb5) /* mu */ \
+   X(arg, 0x03c0, 0xf7, 0x00) /* pi */ \
+   X(arg, 0x03c1, 0xe6, 0x00) /* rho */ \
+   X(arg, 0x03c3, 0xe5, 0x00) /* sigma */ \
+   X(arg, 0x2190, 0x7f, 0x00) /* leftwards arrow */ \
+   X(arg, 0x2192, 0x7e, 0x00) /* rightwards arrow */ \
+   X(arg, 0x221a, 0xe8, 0x00) /* square root */ \
+   X(arg, 0x221e, 0xf3, 0x00) /* infinity */ \
+   X(arg, 0x2588, 0xff, 0x00) /* full block */
+
+/* X(code point, bitmap rows 0-7)
+ * CGRAM glyphs used for code points that the selected ROM can't show */
+#define LCD1602_CHARSET_GLYPHS(X) \
+   X(0x005c, 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00) /* \ */ \
+   X(0x007e, 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00) /* ~ */ \
+   X(0x00e0, 0x08, 0x04, 0x0e, 0x01, 0x0f, 0x11, 0x0f, 0x00) /* a grave */ \
+   X(0x00e7, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e, 0x04, 0x0c) /* c cedilla */ \
+   X(0x00e8, 0x08, 0x04, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00) /* e grave */ \
+   X(0x00e9, 0x02, 0x04, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00) /* e acute */ \
+   X(0x00ea, 0x04, 0x0a, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00) /* e circumflex */ \
+   X(0x20ac, 0x06, 0x09, 0x1c, 0x08, 0x1c, 0x09, 0x06, 0x00) /* euro sign */ \
+   X(0x2190, 0x00, 0x04, 0x08, 0x1f, 0x08, 0x04, 0x00, 0x00) /* leftwards arrow */ \
+   X(0x2191, 0x04, 0x0e, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00) /* upwards arrow */ \
+   X(0x2192, 0x00, 0x04, 0x02, 0x1f, 0x02, 0x04, 0x00, 0x00) /* rightwards arrow */ \
+   X(0x2193, 0x04, 0x04, 0x04, 0x04, 0x15, 0x0e, 0x04, 0x00) /* downwards arrow */ \
+   X(0x2588, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f) /* full block */
+
+#endif /* LCD1602_CHARSET_TABLES_H */
@@ -2,21 +2,51 @@
  *  \license This file is released under the MIT License. See the LICENSE file for details.
  *  \brief esp-idf portability implementation 
  */
+#include <stdlib.h>
 #include <string.h>  /* memcpy */
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "driver/i2c_master.h"
 #include "esp_timer.h"
+#include "esp_rom_sys.h" /* esp_rom_delay_us */
+#include "esp_idf_version.h"
 #include "sys_esp.h"
 #include "sys.h"
 #include "helpers.h"
 
-typedef struct
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
+   #error "lcd1602 requires esp-idf v5.2 or later (i2c_master driver with asynchronous transfers)"
+#endif
+
+#define ESP_I2C_QUEUE_DEPTH      4   /* transfers queued when the library creates the bus */
+#define ESP_I2C_BUFFER_SIZE      255 /* maximum i2c_ll_write length */
+#define ESP_DELAY_BLOCK_MIN_US   100 /* shorter delays busy-wait; longer ones block the calling task */
+
+typedef struct esp_i2c_s
 {
    i2c_lowlevel_config config;
    i2c_master_bus_handle_t bus;
    bool bus_created;
    i2c_master_dev_handle_t device;
+   uint8_t address;
+   uint32_t speed;
    uint32_t timeout;
+
+   /* Asynchronous transfers. Each queued transfer owns one buffer until its on_trans_done
+      callback returns the buffer to the pool via the "free" semaphore. */
+   uint32_t queue_depth; /* 0 if transfers are synchronous */
+   uint8_t *buffers;
+   uint32_t next_buffer;
+   SemaphoreHandle_t free;
+
+   /* Blocking delays. sys_delay_us() has no context, so contexts with a delay timer are kept in
+      esp_delay_list and each delay borrows one that isn't in use. */
+   esp_timer_handle_t delay_timer;
+   SemaphoreHandle_t delay_done;
+   bool delay_busy;
+   struct esp_i2c_s *delay_next;
 } esp_i2c_t;
 
 typedef struct
@@ -24,10 +54,131 @@ typedef struct
    SemaphoreHandle_t mutex;
 } esp_mutex_t;
 
+static portMUX_TYPE esp_delay_lock = portMUX_INITIALIZER_UNLOCKED; /* protects esp_delay_list */
+static esp_i2c_t *esp_delay_list = NULL;
+
 /* ----------------------------------------------------------------------------------------------
  * I2C low-level implementation for esp-idf 
  */
 
+static void esp_delay_done(void *arg)
+{
+   xSemaphoreGive((SemaphoreHandle_t) arg);
+}
+
+/* Creates the context's delay timer once, so that delays don't allocate */
+static bool esp_delay_init(esp_i2c_t *l)
+{
+   esp_timer_create_args_t args = {
+      .callback = esp_delay_done,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "sys_delay",
+   };
+
+   l->delay_done = xSemaphoreCreateBinary();
+   if(NULL == l->delay_done)
+      return false;
+   args.arg = l->delay_done;
+   if(esp_timer_create(&args, &l->delay_timer) != ESP_OK)
+   {
+      vSemaphoreDelete(l->delay_done);
+      l->delay_done = NULL;
+      return false;
+   }
+
+   taskENTER_CRITICAL(&esp_delay_lock);
+   l->delay_next = esp_delay_list;
+   esp_delay_list = l;
+   taskEXIT_CRITICAL(&esp_delay_lock);
+   return true;
+}
+
+/* Unlists the context's delay timer, waiting for a delay that is using it to finish */
+static void esp_delay_deinit(esp_i2c_t *l)
+{
+   esp_i2c_t **link;
+   bool busy;
+
+   if(NULL == l->delay_timer)
+      return;
+   do
+   {
+      taskENTER_CRITICAL(&esp_delay_lock);
+      busy = l->delay_busy;
+      if(!busy)
+      {
+         for(link = &esp_delay_list; *link != l; link = &(*link)->delay_next);
+         *link = l->delay_next;
+      }
+      taskEXIT_CRITICAL(&esp_delay_lock);
+      if(busy)
+         vTaskDelay(1);
+   } while(busy);
+
+   esp_timer_delete(l->delay_timer);
+   vSemaphoreDelete(l->delay_done);
+}
+
+/* Returns a delay timer that isn't in use, or NULL if there is none */
+static esp_i2c_t *esp_delay_acquire(void)
+{
+   esp_i2c_t *l;
+
+   taskENTER_CRITICAL(&esp_delay_lock);
+   for(l = esp_delay_list; NULL != l && l->delay_busy; l = l->delay_next);
+   if(NULL != l)
+      l->delay_busy = true;
+   taskEXIT_CRITICAL(&esp_delay_lock);
+   return l;
+}
+
+static void esp_delay_release(esp_i2c_t *l)
+{
+   taskENTER_CRITICAL(&esp_delay_lock);
+   l->delay_busy = false;
+   taskEXIT_CRITICAL(&esp_delay_lock);
+}
+
+static bool IRAM_ATTR esp_i2c_transfer_done(i2c_master_dev_handle_t device,
+                                            const i2c_master_event_data_t *event, void *arg)
+{
+   esp_i2c_t *l = (esp_i2c_t *) arg;
+   BaseType_t woken = pdFALSE;
+   xSemaphoreGiveFromISR(l->free, &woken);
+   return (woken == pdTRUE);
+}
+
+static bool esp_i2c_async_init(esp_i2c_t *l, uint32_t queue_depth)
+{
+   i2c_master_event_callbacks_t callbacks = { .on_trans_done = esp_i2c_transfer_done };
+
+   l->buffers = (uint8_t *) malloc(queue_depth * ESP_I2C_BUFFER_SIZE);
+   l->free = xSemaphoreCreateCounting(queue_depth, queue_depth);
+   if(NULL == l->buffers || NULL == l->free
+   || i2c_master_register_event_callbacks(l->device, &callbacks, l) != ESP_OK)
+   {
+      SERR("Asynchronous I2C unavailable, using synchronous transfers");
+      if(NULL != l->free)
+         vSemaphoreDelete(l->free);
+      free(l->buffers);
+      l->buffers = NULL;
+      l->free = NULL;
+      return false;
+   }
+
+   l->queue_depth = queue_depth;
+   l->next_buffer = 0;
+   return true;
+}
+
+/* Waits for every queued transfer to complete */
+static bool esp_i2c_drain(esp_i2c_t *l)
+{
+   if(0 == l->queue_depth)
+      return true;
+   return (i2c_master_bus_wait_all_done(*l->config.bus, l->timeout) == ESP_OK);
+}
+
 i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_speed, uint32_t i2c_timeout_ms,
                                       i2c_lowlevel_config *config)
 {
@@ -36,11 +187,21 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
       .device_address = i2c_address,
       .scl_speed_hz = i2c_speed,
    };
+   uint32_t queue_depth;
+   esp_i2c_t *l;
 
-   esp_i2c_t *l = (esp_i2c_t *) calloc(1, sizeof(*l));
+   if(NULL == config)
+   {
+      SERR("[%s] Missing configuration", __func__);
+      return NULL;
+   }
+   queue_depth = config->trans_queue_depth;
+   l = (esp_i2c_t *) calloc(1, sizeof(*l));
    if(NULL == l)
       return NULL; 
    memcpy(&l->config, config, sizeof(l->config));
+   l->address = i2c_address;
+   l->speed = i2c_speed;
    l->timeout = i2c_timeout_ms;
 
    if(NULL == config->bus)
@@ -51,6 +212,7 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
          .sda_io_num = config->pin_sda,
          .scl_io_num = config->pin_scl,
          .glitch_ignore_cnt = 7,
+         .trans_queue_depth = ESP_I2C_QUEUE_DEPTH,
          .flags.enable_internal_pullup = true,      
       };
       if(i2c_new_master_bus(&bus_cfg, &l->bus) != ESP_OK)
@@ -61,6 +223,7 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
       }
       l->config.bus = &l->bus;
       l->bus_created = true;
+      queue_depth = ESP_I2C_QUEUE_DEPTH;
    }
    else
       l->bus_created = false;
@@ -68,56 +231,142 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
    if(i2c_master_bus_add_device(*l->config.bus, &dev_cfg, &l->device) != ESP_OK)
    {
       SERR("I2C initialization failed");
+      if(l->bus_created)
+         i2c_del_master_bus(l->bus);
       free(l);
       return NULL;
    }
 
+   if(queue_depth > 0)
+      esp_i2c_async_init(l, queue_depth);
+   if(!esp_delay_init(l))
+      SERR("Delay timer unavailable, delays will busy-wait");
+
    return (i2c_lowlevel_context) l;
 }
 
 bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
+   esp_delay_deinit(l);
+   esp_i2c_drain(l);
+   i2c_master_bus_rm_device(l->device);
    if(l->bus_created)
       i2c_del_master_bus(l->bus);
+   if(NULL != l->free)
+      vSemaphoreDelete(l->free);
+   free(l->buffers);
    free(l);
    return true;
 }
 
+/* With asynchronous transfers, the data is copied to a driver-owned buffer and this function returns as
+   soon as the transfer is queued. It only blocks if every buffer is still in use. */
 bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_transmit(l->device, data, length, -1) == ESP_OK);
+   uint8_t *buffer;
+
+   if(0 == l->queue_depth)
+      return (i2c_master_transmit(l->device, data, length, l->timeout) == ESP_OK);
+
+   if(xSemaphoreTake(l->free, pdMS_TO_TICKS(l->timeout)) != pdTRUE)
+   {
+      SERR("[%s] Timed out waiting for a transfer buffer", __func__);
+      return false;
+   }
+   buffer = &l->buffers[l->next_buffer * ESP_I2C_BUFFER_SIZE];
+   l->next_buffer = (l->next_buffer + 1) % l->queue_depth;
+   memcpy(buffer, data, length);
+
+   if(i2c_master_transmit(l->device, buffer, length, l->timeout) != ESP_OK)
+   {
+      xSemaphoreGive(l->free);
+      return false;
+   }
+   return true;
 }
 
 bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
-   esp_i2c_t *l = (esp_i2c_t *) ctx;
-   uint8_t *buffer;
-   esp_err_t result;
+   uint8_t buffer[ESP_I2C_BUFFER_SIZE];
 
-   buffer = (uint8_t *) malloc(length + 1);
-   if(NULL == buffer)
+   if(length >= sizeof(buffer))
       return false;
 
    buffer[0] = reg;
    memcpy(&buffer[1], data, length);
-   result = i2c_master_transmit(l->device, buffer, length+1, -1);
-   free(buffer);
-
-   return (result == ESP_OK);
+   return i2c_ll_write(ctx, buffer, length + 1);
 }
 
+/* Reads are always completed before returning, since the caller needs the data */
 bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_receive(l->device, data, length, -1) == ESP_OK);
+
+   if(0 == l->queue_depth)
+      return (i2c_master_receive(l->device, data, length, l->timeout) == ESP_OK);
+
+   if(xSemaphoreTake(l->free, pdMS_TO_TICKS(l->timeout)) != pdTRUE)
+      return false;
+   if(i2c_master_receive(l->device, data, length, l->timeout) != ESP_OK)
+   {
+      xSemaphoreGive(l->free);
+      return false;
+   }
+   return esp_i2c_drain(l);
 }
 
 bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_transmit_receive(l->device, &reg, 1, data, length, -1) == ESP_OK);
+
+   if(0 == l->queue_depth)
+      return (i2c_master_transmit_receive(l->device, &reg, 1, data, length, l->timeout) == ESP_OK);
+
+   if(xSemaphoreTake(l->free, pdMS_TO_TICKS(l->timeout)) != pdTRUE)
+      return false;
+   if(i2c_master_transmit_receive(l->device, &reg, 1, data, length, l->timeout) != ESP_OK)
+   {
+      xSemaphoreGive(l->free);
+      return false;
+   }
+   return esp_i2c_drain(l);
+}
+
+/* The clock speed belongs to the device handle, so the device is re-added to the bus */
+bool SYS_WEAK i2c_ll_set_speed(i2c_lowlevel_context ctx, uint32_t i2c_speed)
+{
+   esp_i2c_t *l = (esp_i2c_t *) ctx;
+   i2c_master_event_callbacks_t callbacks = { .on_trans_done = esp_i2c_transfer_done };
+   i2c_device_config_t dev_cfg = {
+      .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+      .device_address = l->address,
+      .scl_speed_hz = i2c_speed,
+   };
+
+   if(i2c_speed == l->speed)
+      return true;
+   if(!esp_i2c_drain(l) || i2c_master_bus_rm_device(l->device) != ESP_OK)
+      return false;
+
+   if(i2c_master_bus_add_device(*l->config.bus, &dev_cfg, &l->device) == ESP_OK)
+      l->speed = i2c_speed;
+   else
+   {
+      SERR("[%s] Failed to set %" PRIu32 " Hz", __func__, i2c_speed);
+      dev_cfg.scl_speed_hz = l->speed;
+      if(i2c_master_bus_add_device(*l->config.bus, &dev_cfg, &l->device) != ESP_OK)
+         return false;
+   }
+
+   if(l->queue_depth > 0
+   && i2c_master_register_event_callbacks(l->device, &callbacks, l) != ESP_OK)
+   {
+      SERR("Asynchronous I2C unavailable, using synchronous transfers");
+      l->queue_depth = 0; /* every buffer is free after draining */
+   }
+   return (l->speed == i2c_speed);
 }
 
 mutex_lowlevel SYS_WEAK sys_mutex_init(void)
@@ -161,3 +410,27 @@ uint64_t SYS_WEAK sys_microsecond_tick(void)
 {
    return esp_timer_get_time(); /* microseconds since boot */
 }
+
+/* Delays long enough to be worth a context switch block the calling task on a one-shot esp_timer,
+   leaving the CPU free for other tasks (or idle, allowing light sleep) instead of spinning. Whatever
+   the timer didn't cover (no idle timer, a failed start, a late callback) is busy-waited. */
+int SYS_WEAK sys_delay_us(size_t x)
+{
+   uint64_t start = esp_timer_get_time();
+   uint64_t elapsed;
+   esp_i2c_t *l;
+
+   if(x >= ESP_DELAY_BLOCK_MIN_US && NULL != (l = esp_delay_acquire()))
+   {
+      xSemaphoreTake(l->delay_done, 0); /* a callback that fired after a previous wait gave up */
+      if(esp_timer_start_once(l->delay_timer, x) == ESP_OK
+      && xSemaphoreTake(l->delay_done, pdMS_TO_TICKS((x + 999) / 1000) + 2) != pdTRUE)
+         esp_timer_stop(l->delay_timer);
+      esp_delay_release(l);
+   }
+
+   elapsed = esp_timer_get_time() - start;
+   if(elapsed < x)
+      esp_rom_delay_us(x - elapsed);
+   return 0;
+}
@@ -0,0 +1,242 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Linux i2c-dev interface, for the i2c_ll_* functions and the i2cdev transport
+ *
+ * Adapters with plain i2c support get full-length writes, and reads that are a single I2C_RDWR
+ * transaction. SMBus-only adapters (e.g. the i2c-stub module) are driven with SMBus transfers whose
+ * bytes on the wire are the same as a plain write: an i2c block write sends its command byte followed
+ * by the data, and a send byte is a one-byte write. Adapters must support at least one of plain i2c
+ * writes and SMBus send byte.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h> /* open/close */
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "lcd1602_protocol.h"
+#include "sys_linux.h"
+#include "helpers.h"
+#include "lcd1602.h"
+#include "i2cdev.h"
+
+struct i2cdev_s
+{
+   int handle;
+   uint8_t address;
+   unsigned long functions; /* I2C_FUNC_* of the adapter */
+};
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Internal Functions
+ */
+
+i2cdev_t *i2cdev_init(const char *device, uint8_t i2c_address, uint32_t i2c_timeout_ms, lcd1602_transport_caps *caps)
+{
+   i2cdev_t *d;
+   int result = -1;
+
+   d = (i2cdev_t *) malloc(sizeof(*d));
+   if(NULL == d)
+   {
+      SERR("[%s] Failed to allocate low-level structure", __func__);
+      return NULL;
+   }
+   d->address = i2c_address;
+   d->functions = 0;
+
+   d->handle = open(device, O_RDWR);
+   if(d->handle < 0)
+   {
+      SERR("[%s] Failed to open device '%s'", __func__, device);
+   }
+   else if(ioctl(d->handle, I2C_SLAVE, i2c_address) < 0)
+   {
+      SERR("[%s] Failed to set I2C slave address to 0x%02x", __func__, i2c_address);
+   }
+   else if(ioctl(d->handle, I2C_FUNCS, &d->functions) < 0)
+   {
+      SERR("[%s] Failed to query adapter functionality (errno %d)", __func__, errno);
+   }
+   else if(!(d->functions & (I2C_FUNC_I2C | I2C_FUNC_SMBUS_WRITE_BYTE)))
+   {
+      /* Block writes alone can't send the single bytes the library needs */
+      SERR("[%s] Adapter supports neither i2c writes nor SMBus send byte (functions 0x%lx)", __func__,
+         d->functions);
+   }
+   else
+      result = 0;
+
+   if(0 != result)
+   {
+      i2cdev_deinit(d);
+      return NULL;
+   }
+
+   /* In units of 10 ms; not every adapter honors it */
+   if(ioctl(d->handle, I2C_TIMEOUT, (i2c_timeout_ms + 9) / 10) < 0)
+   {
+      SDBG("[%s] Adapter ignored the %u ms timeout", __func__, i2c_timeout_ms);
+   }
+
+   if(d->functions & I2C_FUNC_I2C)
+   {
+      caps->maxWrite = LCD1602_MAX_TRANSFER_SIZE;
+      caps->read = true;
+      caps->vectored = true;
+   }
+   else
+   {
+      caps->maxWrite = (d->functions & I2C_FUNC_SMBUS_WRITE_I2C_BLOCK) ? 1 + I2C_SMBUS_BLOCK_MAX : 1;
+      caps->read = (d->functions & I2C_FUNC_SMBUS_READ_BYTE) != 0;
+      caps->vectored = false;
+   }
+   SDBG("[%s] Adapter functions 0x%lx, %u bytes per write", __func__, d->functions, caps->maxWrite);
+   return d;
+}
+
+void i2cdev_deinit(i2cdev_t *d)
+{
+   if(NULL == d)
+      return;
+   if(d->handle >= 0)
+      close(d->handle);
+   free(d);
+}
+
+int i2cdev_smbus(i2cdev_t *d, uint8_t read_write, uint8_t command, uint32_t size, union i2c_smbus_data *data)
+{
+   struct i2c_smbus_ioctl_data args;
+
+   args.read_write = read_write;
+   args.command = command;
+   args.size = size;
+   args.data = data;
+   return ioctl(d->handle, I2C_SMBUS, &args);
+}
+
+bool i2cdev_write(i2cdev_t *d, const uint8_t *data, uint16_t length)
+{
+   union i2c_smbus_data smdata;
+   int result;
+
+   if(d->functions & I2C_FUNC_I2C)
+      result = (write(d->handle, data, length) == length) ? 0 : -1;
+   else if(1 == length)
+      result = i2cdev_smbus(d, I2C_SMBUS_WRITE, data[0], I2C_SMBUS_BYTE, NULL);
+   else if(length <= 1 + I2C_SMBUS_BLOCK_MAX && (d->functions & I2C_FUNC_SMBUS_WRITE_I2C_BLOCK))
+   {
+      smdata.block[0] = length - 1;
+      memcpy(&smdata.block[1], &data[1], length - 1);
+      result = i2cdev_smbus(d, I2C_SMBUS_WRITE, data[0], I2C_SMBUS_I2C_BLOCK_DATA, &smdata);
+   }
+   else
+      result = -EINVAL;
+
+   if(0 == result)
+   {
+      SDBG("[%s] Success (%u bytes)", __func__, length);
+      return true;
+   }
+   SERR("[%s] Failed (%u bytes, result %d, errno %d)", __func__, length, result, errno);
+   return false;
+}
+
+bool i2cdev_read(i2cdev_t *d, uint8_t *data, uint16_t length)
+{
+   union i2c_smbus_data smdata;
+   uint16_t i;
+
+   if(d->functions & I2C_FUNC_I2C)
+   {
+      if(read(d->handle, data, length) == length)
+         return true;
+   }
+   else
+   {
+      for(i = 0; i < length && i2cdev_smbus(d, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &smdata) == 0; ++i)
+         data[i] = smdata.byte;
+      if(i == length)
+         return true;
+   }
+
+   SERR("[%s] Failed (%u bytes, errno %d)", __func__, length, errno);
+   memset(data, 0, length);
+   return false;
+}
+
+bool i2cdev_transfer(i2cdev_t *d, const lcd1602_transport_segment *segments, uint16_t count)
+{
+   struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+   struct i2c_rdwr_ioctl_data args;
+   uint16_t i;
+
+   if(count > I2C_RDWR_IOCTL_MAX_MSGS)
+      return false;
+   for(i = 0; i < count; ++i)
+   {
+      messages[i].addr = d->address;
+      messages[i].flags = (segments[i].read) ? I2C_M_RD : 0;
+      messages[i].len = segments[i].length;
+      messages[i].buf = segments[i].data;
+   }
+   args.msgs = messages;
+   args.nmsgs = count;
+   if(ioctl(d->handle, I2C_RDWR, &args) == (int) count)
+      return true;
+
+   SERR("[%s] Failed (%u segments, errno %d)", __func__, count, errno);
+   return false;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Transport
+ */
+
+static void *i2cdev_transport_open(const void *config, uint8_t i2cAddress, uint32_t busSpeed, uint32_t timeoutMs,
+   lcd1602_transport_caps *caps)
+{
+   (void) busSpeed; /* set by the kernel, e.g. the device tree's clock-frequency */
+   if(NULL == config)
+   {
+      SERR("[%s] Missing configuration", __func__);
+      return NULL;
+   }
+   return i2cdev_init(((const i2c_lowlevel_config *) config)->device, i2cAddress, timeoutMs, caps);
+}
+
+static void i2cdev_transport_close(void *handle)
+{
+   i2cdev_deinit((i2cdev_t *) handle);
+}
+
+static bool i2cdev_transport_write(void *handle, const uint8_t *data, uint16_t length)
+{
+   return i2cdev_write((i2cdev_t *) handle, data, length);
+}
+
+static bool i2cdev_transport_read(void *handle, uint8_t *data, uint16_t length)
+{
+   return i2cdev_read((i2cdev_t *) handle, data, length);
+}
+
+static bool i2cdev_transport_transfer(void *handle, const lcd1602_transport_segment *segments, uint16_t count)
+{
+   return i2cdev_transfer((i2cdev_t *) handle, segments, count);
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Data
+ */
+
+const lcd1602_transport lcd1602_transport_i2cdev = {
+   .name = "i2cdev",
+   .open = i2cdev_transport_open,
+   .close = i2cdev_transport_close,
+   .write = i2cdev_transport_write,
+   .read = i2cdev_transport_read,
+   .transfer = i2cdev_transport_transfer,
+   .set_speed = NULL /* the adapter's clock is set by the kernel */
+};
@@ -0,0 +1,22 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Linux i2c-dev interface
+ */
+#ifndef _I2CDEV_H
+#define _I2CDEV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/i2c.h>
+#include "lcd1602.h"
+
+typedef struct i2cdev_s i2cdev_t;
+
+i2cdev_t *i2cdev_init(const char *device, uint8_t i2c_address, uint32_t i2c_timeout_ms, lcd1602_transport_caps *caps);
+void i2cdev_deinit(i2cdev_t *d);
+bool i2cdev_write(i2cdev_t *d, const uint8_t *data, uint16_t length);
+bool i2cdev_read(i2cdev_t *d, uint8_t *data, uint16_t length);
+bool i2cdev_transfer(i2cdev_t *d, const lcd1602_transport_segment *segments, uint16_t count);
+int i2cdev_smbus(i2cdev_t *d, uint8_t read_write, uint8_t command, uint32_t size, union i2c_smbus_data *data);
+
+#endif /* _I2CDEV_H */
@@ -13,7 +13,17 @@
 
 /* Forward function declarations */
 static int lcd1602_write_nibble(lcd1602_t *c, uint8_t value, bool isData);
-static int lcd1602_write_byte(lcd1602_t *c, uint8_t value, bool isData, uint32_t delay);
+static int lcd1602_request_locked(lcd1602_t *c, uint8_t value, bool isData, uint32_t delay);
+static int lcd1602_request(lcd1602_t *c, uint8_t value, bool isData, uint32_t delay);
+static int lcd1602_attach(lcd1602_t *c, const lcd1602_snapshot *snapshot);
+static bool lcd1602_cursor_visible(lcd1602_state_t *s);
+static int lcd1602_seek(lcd1602_t *c, bool cgramSelected, uint8_t address);
+static uint8_t lcd1602_backlight_flag(lcd1602_t *c);
+static void lcd1602_frame_begin(lcd1602_t *c);
+static int lcd1602_power_step(lcd1602_t *c, uint64_t currentTime);
+static lcd1602_t *lcd1602_open(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config, bool warm, const lcd1602_snapshot *snapshot);
+static int lcd1602_transport_write(lcd1602_t *c, const uint8_t *data, uint16_t length);
 
 /* -----------------------------------------------------------------------------------------------------------
  * Exported Functions 
@@ -21,64 +31,51 @@ static int lcd1602_write_byte(lcd1602_t *c, uint8_t value, bool isData, uint32_t
 
 lcd1602_context lcd1602_init(uint8_t i2cAddress, bool backlightOn, i2c_lowlevel_config *config)
 {
-   lcd1602_t *c;
-   bool success = false;
-
-   c = (lcd1602_t *) malloc(sizeof(*c));
-   if(NULL == c)
-      return NULL;
-   memset(c, 0, sizeof(*c));
-   c->i2cAddress = i2cAddress;
-   c->backlightOn = backlightOn;
-
-   c->i2c = i2c_ll_init(i2cAddress, LCD1602_I2C_SPEED, LCD1602_I2C_TRANSFER_TIMEOUT, config);
-   if(NULL == c->i2c)
-   {
-      SERR("[%s] i2c low-level initialization failed", __func__);
-   }
-   else
-   {
-      c->mutex = sys_mutex_init();
-      if(NULL == c->mutex)
-      {
-         SERR("[%s] mutex low-level initialization failed", __func__);
-      }
-      else
-      {
-         if(lcd1602_reset(c) != 0)
-         {
-            SERR("[%s] lcd1602 reset failed", __func__);
-         }
-         else
-            success = true;
+   return (lcd1602_context) lcd1602_open(i2cAddress, backlightOn, &lcd1602_transport_sys, config, false, NULL);
+}
 
-         if(!success)
-            sys_mutex_deinit(c->mutex);
-      }
+lcd1602_context lcd1602_init_transport(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config)
+{
+   return (lcd1602_context) lcd1602_open(i2cAddress, backlightOn, transport, config, false, NULL);
+}
 
-      if(!success)
-         i2c_ll_deinit(c->i2c);
-   }
+lcd1602_context lcd1602_init_warm(uint8_t i2cAddress, bool backlightOn, i2c_lowlevel_config *config,
+   const lcd1602_snapshot *snapshot)
+{
+   return lcd1602_init_warm_transport(i2cAddress, backlightOn, &lcd1602_transport_sys, config, snapshot);
+}
 
-   if(!success)
+lcd1602_context lcd1602_init_warm_transport(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config, const lcd1602_snapshot *snapshot)
+{
+   if(NULL != snapshot && LCD1602_SNAPSHOT_VERSION != snapshot->version)
    {
-      free(c);
-      c = NULL;
+      SERR("[%s] Ignoring snapshot version %" PRIu32, __func__, snapshot->version);
+      snapshot = NULL;
    }
-   return (lcd1602_context) c;
+   return (lcd1602_context) lcd1602_open(i2cAddress, backlightOn, transport, config, true, snapshot);
 }
 
 void lcd1602_deinit(lcd1602_context context)
 {
    lcd1602_t *c = (lcd1602_t *) context;
+   sys_mutex_lock(c->mutex);
+   if(c->writeBehind)
+      lcd1602_sync(c);
+   lcd1602_frame_begin(c); /* the last instruction completes before the panel is handed on */
+   sys_mutex_unlock(c->mutex);
    sys_mutex_deinit(c->mutex);
-   i2c_ll_deinit(c->i2c);
+   c->transport->close(c->i2c);
    free(c);    
 }
 
 int lcd1602_reset(lcd1602_context context)
 {
    lcd1602_t *c = (lcd1602_t *) context;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
 
    sys_delay_us(15000); /* wait time >= 15 ms after VCC > 4.5V */ 
 
@@ -89,80 +86,198 @@ int lcd1602_reset(lcd1602_context context)
    || lcd1602_write_nibble(c, 0x02, false) != 0
    || sys_delay_us(LCD1602_DELAY_ENABLE_PULSE_SETTLE) != 0
    || lcd1602_write_byte(c, LCD1602_CMD_FUNCTION_SET | FLAG_FUNCTION_SET_LINES_2, false, 0) != 0
-   || lcd1602_set_display(c, true, false, false) != 0
-   || lcd1602_clear(c) != 0
-   || lcd1602_set_mode(c, true, false) != 0)
+   || lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL | LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY,
+                         false, c->timing.modeSet) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_CLEAR, false, c->timing.clear) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                         false, c->timing.modeSet) != 0
+   || lcd1602_frame_flush(c) != 0)
    {
-      return -1;
+      result = -1;
    }
 
-   return 0; 
+   lcd1602_state_reset(&c->panel);
+   memcpy(&c->shadow, &c->panel, sizeof(c->shadow));
+   c->panelValid = (0 == result);
+   c->panelGlyphs = 0;    /* CGRAM contents are undefined after power-on */
+   c->glyphReserved = 0;
+   c->glyphAllocated = 0;
+
+   sys_mutex_unlock(c->mutex);
+
+   return result; 
+}
+
+int lcd1602_get_snapshot(lcd1602_context context, lcd1602_snapshot *snapshot)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
+   if(!c->panelValid)
+      result = -1;
+   else
+   {
+      /* What the panel holds, not what's pending in write-behind mode */
+      memset(snapshot, 0, sizeof(*snapshot));
+      snapshot->version = LCD1602_SNAPSHOT_VERSION;
+      memcpy(snapshot->ddram, c->panel.ddram, sizeof(snapshot->ddram));
+      memcpy(snapshot->cgram, c->panel.cgram, sizeof(snapshot->cgram));
+      snapshot->glyphs = c->panelGlyphs;
+      snapshot->address = c->shadow.address; /* the panel's may lag behind, see lcd1602_request_locked() */
+      snapshot->cgramSelected = c->shadow.cgramSelected;
+      snapshot->entryMode = c->panel.entryMode;
+      snapshot->displayControl = c->panel.displayControl;
+      snapshot->displayShift = c->panel.displayShift;
+   }
+   sys_mutex_unlock(c->mutex);
+
+   return result;
 }
 
 int lcd1602_clear(lcd1602_context context)
 {
-   return lcd1602_write_byte((lcd1602_t *) context, LCD1602_CMD_CLEAR, false, LCD1602_DELAY_CLEAR);
+   lcd1602_t *c = (lcd1602_t *) context;
+   return lcd1602_request(c, LCD1602_CMD_CLEAR, false, c->timing.clear);
 }
 
 int lcd1602_home(lcd1602_context context)
 {
-   return lcd1602_write_byte((lcd1602_t *) context, LCD1602_CMD_HOME, false, LCD1602_DELAY_HOME);
+   lcd1602_t *c = (lcd1602_t *) context;
+   return lcd1602_request(c, LCD1602_CMD_HOME, false, c->timing.clear);
 }
 
 int lcd1602_set_display(lcd1602_context context, bool displayEnabled, bool cursorEnabled, bool blinkEnabled)
 {
-   return lcd1602_write_byte((lcd1602_t *) context,
+   lcd1602_t *c = (lcd1602_t *) context;
+   return lcd1602_request(c,
       LCD1602_CMD_DISPLAY_CONTROL
       | ((displayEnabled) ? LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY : 0)
       | ((cursorEnabled)  ? LCD1602_DISPLAY_CONTROL_FLAG_CURSOR  : 0)
-      | ((blinkEnabled)   ? LCD1602_DISPLAY_CONTROL_FLAG_BLINK   : 0), false, 4100);
+      | ((blinkEnabled)   ? LCD1602_DISPLAY_CONTROL_FLAG_BLINK   : 0), false, c->timing.modeSet);
 }
 
 int lcd1602_set_mode(lcd1602_context context, bool leftToRight, bool autoScroll)
 {
-   return lcd1602_write_byte((lcd1602_t *) context,
+   lcd1602_t *c = (lcd1602_t *) context;
+   return lcd1602_request(c,
       LCD1602_CMD_ENTRY_MODE_SET
       | ((leftToRight) ? LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT : 0)
-      | ((autoScroll)  ? LCD1602_ENTRY_MODE_SET_FLAG_SHIFT     : 0), false, 4100);
+      | ((autoScroll)  ? LCD1602_ENTRY_MODE_SET_FLAG_SHIFT     : 0), false, c->timing.modeSet);
 }
 
 int lcd1602_char(lcd1602_context context, char c)
 {
-   return lcd1602_write_byte((lcd1602_t *) context, c, true, 0); 
+   return lcd1602_request((lcd1602_t *) context, c, true, 0); 
 }
 
 int lcd1602_string(lcd1602_context context, char *s)
 {
+   lcd1602_t *c = (lcd1602_t *) context;
    uint32_t count;
-   int result;
+   int result = 0;
    
+   sys_mutex_lock(c->mutex);
    for(count = 0; count < LCD1602_MAX_CHAR_WRITE_COUNT && s[count] != '\0'; ++count)
    { 
-      result = lcd1602_write_byte((lcd1602_t *) context, s[count], true, 0);
+      result = lcd1602_yield(c);
+      if(0 == result)
+         result = lcd1602_request_locked(c, s[count], true, 0);
       if(0 != result)
       {
          SERR("[%s] Failed to write character index %" PRIu32 " (result %d)\n",
             __func__, count, result);
-         return result;
+         break;
       }
    }
+   if(0 == result)
+      result = lcd1602_frame_flush(c);
+   sys_mutex_unlock(c->mutex);
+   return result;
+}
+
+int lcd1602_set_charset(lcd1602_context context, eLCD1602Charset charset)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   if(charset != LCD1602_CHARSET_A00 && charset != LCD1602_CHARSET_A02)
+      return -1;
+   c->charset = charset;
    return 0;
 }
 
+int lcd1602_string_utf8(lcd1602_context context, const char *s)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   uint32_t count, codepoint;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
+   for(count = 0; count < LCD1602_MAX_CHAR_WRITE_COUNT && *s != '\0' && 0 == result; ++count)
+   {
+      int code;
+
+      result = lcd1602_yield(c);
+      if(0 != result)
+         break;
+      codepoint = lcd1602_utf8_decode(&s);
+      code = lcd1602_charset_code(c->charset, codepoint);
+      if(code < 0)
+      {
+         const uint8_t *bitmap = lcd1602_charset_glyph(codepoint);
+         if(NULL != bitmap)
+         {
+            code = lcd1602_glyph(c, bitmap);
+            if(code >= 0)
+               result = lcd1602_update(c); /* glyph must be loaded before it's referenced */
+         }
+         if(code < 0)
+            code = '?';
+      }
+
+      if(0 == result)
+         result = lcd1602_request_locked(c, (uint8_t) code, true, 0);
+      if(0 != result)
+      {
+         SERR("[%s] Failed to write character index %" PRIu32 " (result %d)\n",
+            __func__, count, result);
+      }
+   }
+   if(0 == result)
+      result = lcd1602_frame_flush(c);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
 int lcd1602_scroll(lcd1602_context context, eLCD1602ScrollTarget target,
    eLCD1602ScrollDirection direction)
 {
-   return lcd1602_write_byte((lcd1602_t *) context,
+   return lcd1602_request((lcd1602_t *) context,
       LCD1602_CMD_SHIFT
       | ((LCD1602_SCROLL_DISPLAY == target) ? LCD1602_SHIFT_FLAG_DISPLAY : 0)
-      | ((LCD1602_SCROLL_LEFT == direction) ? LCD1602_SHIFT_FLAG_LEFT : 0), false, 0);
+      | ((LCD1602_SCROLL_RIGHT == direction) ? LCD1602_SHIFT_FLAG_RIGHT : 0), false, 0);
 }
 
 int lcd1602_set_backlight(lcd1602_context context, bool enable)
 {
    lcd1602_t *c = (lcd1602_t *) context;
+   int result;
+
+   sys_mutex_lock(c->mutex);
    c->backlightOn = enable;
-   return 0; 
+
+   /* The PCF8574 only changes its outputs when written, so send a byte that leaves E low rather than
+      waiting for the next instruction */
+   result = lcd1602_frame_flush(c);
+   if(0 == result)
+   {
+      lcd1602_frame_begin(c);
+      c->frame[c->frameLength++] = lcd1602_backlight_flag(c);
+      result = lcd1602_frame_flush(c);
+   }
+   sys_mutex_unlock(c->mutex);
+
+   return result;
 }
 
 int lcd1602_set_cursor(lcd1602_context context, uint16_t row, uint16_t column)
@@ -170,49 +285,446 @@ int lcd1602_set_cursor(lcd1602_context context, uint16_t row, uint16_t column)
    if(row >= LCD1602_MAX_ROWS || column >= LCD1602_MAX_COLUMNS)
       return -1;
 
-   return lcd1602_write_byte((lcd1602_t *) context,
+   return lcd1602_request((lcd1602_t *) context,
       LCD1602_CMD_SET_DDRAM_ADDR
       | (column + LCD1602_ROW_OFFSET[row]), false, 0);
 }
 
+int lcd1602_define_char(lcd1602_context context, uint8_t slot, const uint8_t *bitmap)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   int result;
+
+   if(slot >= LCD1602_CGRAM_SLOTS)
+      return -1;
+
+   sys_mutex_lock(c->mutex);
+   memcpy(&c->shadow.cgram[slot * LCD1602_GLYPH_SIZE], bitmap, LCD1602_GLYPH_SIZE);
+   c->glyphReserved |= (1 << slot);
+   c->glyphAllocated &= ~(1 << slot);
+   result = lcd1602_update(c);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_set_write_behind(lcd1602_context context, bool enable, uint32_t maxFps)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
+   if((c->writeBehind && !enable) || c->powerIdle)
+      result = lcd1602_sync(c);
+   c->writeBehind = enable;
+   c->powerSave = false;
+   c->frameInterval = (maxFps > 0) ? (1000000 / maxFps) : 0;
+   c->nextFrame = 0;
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_flush(lcd1602_context context)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   uint64_t currentTime;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
+   currentTime = sys_microsecond_tick();
+   if(c->powerSave)
+      result = lcd1602_power_step(c, currentTime);
+   else if(c->writeBehind && currentTime >= c->nextFrame)
+   {
+      result = lcd1602_sync(c);
+      c->nextFrame = currentTime + c->frameInterval;
+   }
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_set_power_save(lcd1602_context context, uint32_t batchWindowMs, uint32_t idleTimeoutMs)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   int result = 0;
+
+   sys_mutex_lock(c->mutex);
+   if(0 == batchWindowMs && 0 == idleTimeoutMs)
+   {
+      if(c->writeBehind || c->pendingChanges || c->powerIdle)
+         result = lcd1602_sync(c);
+      if(c->powerSave)
+         c->writeBehind = c->powerSaveResume;
+      c->powerSave = false;
+   }
+   else
+   {
+      if(!c->powerSave)
+         c->powerSaveResume = c->writeBehind;
+      c->powerSave = true;
+      c->writeBehind = true;
+      c->batchWindow = (uint64_t) batchWindowMs * 1000;
+      c->idleTimeout = (uint64_t) idleTimeoutMs * 1000;
+      c->lastActivity = sys_microsecond_tick();
+      if(c->pendingChanges)
+         c->batchStart = c->lastActivity; /* changes made before now join the first batch */
+   }
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+uint32_t lcd1602_next_flush(lcd1602_context context)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   uint64_t currentTime, due = 0;
+   bool scheduled = true;
+   uint32_t result = LCD1602_NEXT_FLUSH_NONE;
+
+   sys_mutex_lock(c->mutex);
+   currentTime = sys_microsecond_tick();
+   if(!c->writeBehind)
+      scheduled = false;
+   else if(c->pendingChanges)
+      due = (c->powerSave) ? (c->batchStart + c->batchWindow) : c->nextFrame; /* 0 if a frame is due now */
+   else if(c->powerSave && !c->powerIdle && c->idleTimeout > 0)
+      due = c->lastActivity + c->idleTimeout;
+   else
+      scheduled = false;
+
+   if(scheduled)
+      result = (due <= currentTime) ? 0
+             : (due - currentTime >= LCD1602_NEXT_FLUSH_NONE) ? LCD1602_NEXT_FLUSH_NONE - 1
+             : (uint32_t) (due - currentTime);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_write_urgent(lcd1602_context context, uint16_t row, uint16_t column, const char *s)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   uint8_t entryMode;
+   bool woken = false;
+   int index, result = 0;
+
+   if(lcd1602_cell_index(row, column) < 0)
+      return -1;
+
+   /* Announced before waiting for the mutex, so that background writers step aside between bytes */
+   __atomic_add_fetch(&c->urgentPending, 1, __ATOMIC_ACQ_REL);
+   sys_mutex_lock(c->mutex);
+   __atomic_sub_fetch(&c->urgentPending, 1, __ATOMIC_ACQ_REL);
+
+   if(c->powerIdle)
+   {
+      /* Wake the panel; the cells below are written before the display is switched back on */
+      c->powerIdle = false;
+      woken = true;
+   }
+   c->lastActivity = sys_microsecond_tick();
+
+   /* The cells are written straight to both states, bypassing write-behind mode and leaving the
+      application's cursor and entry mode alone */
+   entryMode = c->panel.entryMode;
+   if(c->panelValid && entryMode != LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT)
+      result = lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                                  false, c->timing.modeSet);
+   for(; 0 == result && *s != '\0' && (index = lcd1602_cell_index(row, column)) >= 0; ++s, ++column)
+   {
+      c->shadow.ddram[index] = (uint8_t) *s;
+      if(!c->panelValid || c->panel.ddram[index] == (uint8_t) *s)
+         continue; /* an invalid panel is redrawn from the shadow by the next sync */
+      if(lcd1602_seek(c, false, (uint8_t) index) != 0
+      || lcd1602_write_byte(c, (uint8_t) *s, true, 0) != 0)
+         result = -1;
+   }
+   if(0 == result && c->panelValid && c->panel.entryMode != entryMode)
+      result = lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | entryMode, false, c->timing.modeSet);
+   if(0 == result && woken)
+      result = lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL | c->shadow.displayControl,
+                                  false, c->timing.modeSet);
+   if(0 == result && lcd1602_cursor_visible(&c->panel))
+      result = lcd1602_seek(c, c->shadow.cgramSelected, c->shadow.address);
+   if(0 == result)
+      result = lcd1602_frame_flush(c);
+
+   sys_mutex_unlock(c->mutex);
+   return result;
+}
+
 /* -----------------------------------------------------------------------------------------------------------
- * Private Helper Functions
+ * Internal Functions
  */
 
-static int lcd1602_ll_write_byte(lcd1602_t *c, uint8_t data)
+/* Caller must hold c->mutex. Sends shadow changes made outside of lcd1602_request() to the panel,
+   unless write-behind mode defers them to the next lcd1602_flush(). */
+int lcd1602_update(lcd1602_t *c)
 {
-   return (i2c_ll_write(c->i2c, &data, sizeof(data))) ? 0 : -1;
+   if(!c->writeBehind)
+      return lcd1602_sync(c);
+   lcd1602_mark_pending(c);
+   return 0;
 }
 
-/* The lower 4 bits of "value" are transferred by this function. The caller is responsible for ensuring
-   a delay of LCD1602_DELAY_ENABLE_PULSE_SETTLE occurs before the next i2c transfer. */
-static int lcd1602_write_nibble(lcd1602_t *c, uint8_t value, bool isData)
+/* Caller must hold c->mutex. Notes a write-behind change; the batch window starts with the first one. */
+void lcd1602_mark_pending(lcd1602_t *c)
+{
+   if(c->pendingChanges)
+      return;
+   c->pendingChanges = true;
+   if(c->powerSave)
+      c->batchStart = sys_microsecond_tick();
+}
+
+/* Caller must hold c->mutex. Power-save mode's lcd1602_flush(): sends changes once the batch window
+   that began with the first of them has passed, and switches the display and backlight off after
+   the idle timeout. The next change to be sent switches them back on. */
+static int lcd1602_power_step(lcd1602_t *c, uint64_t currentTime)
+{
+   if(c->pendingChanges)
+   {
+      if(currentTime < c->batchStart + c->batchWindow)
+         return 0;
+      c->lastActivity = currentTime;
+      return lcd1602_sync(c);
+   }
+
+   if(c->powerIdle || 0 == c->idleTimeout || currentTime < c->lastActivity + c->idleTimeout)
+      return 0;
+
+   /* The backlight flag goes out with the display-off instruction */
+   c->powerIdle = true;
+   if(lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL
+                         | (c->panel.displayControl & ~LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY),
+                         false, c->timing.modeSet) != 0)
+      return -1;
+   return lcd1602_frame_flush(c);
+}
+
+/* Caller must hold c->mutex, between complete instructions. If an urgent write is waiting, sends
+   what's queued and releases the mutex until every urgent writer has taken its turn. */
+int lcd1602_yield(lcd1602_t *c)
+{
+   int result;
+
+   if(0 == __atomic_load_n(&c->urgentPending, __ATOMIC_ACQUIRE))
+      return 0;
+
+   result = lcd1602_frame_flush(c);
+   sys_mutex_unlock(c->mutex);
+   while(__atomic_load_n(&c->urgentPending, __ATOMIC_ACQUIRE) > 0)
+      sys_delay_us(LCD1602_YIELD_POLL_INTERVAL);
+   sys_mutex_lock(c->mutex);
+
+   return result;
+}
+
+static bool lcd1602_glyph_visible(lcd1602_t *c, uint8_t slot)
+{
+   uint8_t index;
+   for(index = 0; index < LCD1602_DDRAM_SIZE; ++index)
+   {
+      /* Character codes 8-15 are aliases of 0-7 */
+      if((c->shadow.ddram[index] & ~0x08) == slot || (c->panel.ddram[index] & ~0x08) == slot)
+         return true;
+   }
+   return false;
+}
+
+/* Caller must hold c->mutex. Returns the character code (CGRAM slot) showing the given bitmap,
+   loading it into the shadow CGRAM if it isn't already there, or -1 if every slot is either
+   reserved by the application or currently on screen. */
+int lcd1602_glyph(lcd1602_t *c, const uint8_t *bitmap)
 {
-   uint8_t flags = ((c->backlightOn) ? LCD1602_FLAG_BACKLIGHT_ON : 0)
-                 | ((isData) ? LCD1602_FLAG_RS_DATA : 0); /* if not isData, then control */
+   int slot, victim = -1;
 
-   /* I2C byte is clocked-in on the falling edge of LCD1602_FLAG_ENABLE */
-   if(lcd1602_ll_write_byte(c, ((value << 4) & 0xf0) | flags) != 0
-   || sys_delay_us(1) != 0  /* data setup time */
-   || lcd1602_ll_write_byte(c, ((value << 4) & 0xf0) | flags | LCD1602_FLAG_ENABLE) != 0
-   || sys_delay_us(1) != 0  /* pulse width */
-   || lcd1602_ll_write_byte(c, (((value << 4) & 0xf0) | flags) & ~LCD1602_FLAG_ENABLE) != 0)
+   for(slot = 0; slot < LCD1602_CGRAM_SLOTS; ++slot)
    {
-      SERR("[%s] Failed to transfer 0x%02x\n", __func__, value);
+      if((c->glyphAllocated & (1 << slot))
+      && memcmp(&c->shadow.cgram[slot * LCD1602_GLYPH_SIZE], bitmap, LCD1602_GLYPH_SIZE) == 0)
+      {
+         c->glyphUse[slot] = ++c->glyphClock;
+         return slot;
+      }
+   }
+
+   /* Prefer an empty slot, otherwise evict the least-recently used glyph. Displayed slots are never
+      taken, including unallocated ones still showing what a previous owner left (see lcd1602_attach()). */
+   for(slot = 0; slot < LCD1602_CGRAM_SLOTS; ++slot)
+   {
+      if((c->glyphReserved & (1 << slot)) || lcd1602_glyph_visible(c, slot))
+         continue;
+      if(!(c->glyphAllocated & (1 << slot)))
+      {
+         victim = slot;
+         break;
+      }
+      if(victim < 0 || c->glyphUse[slot] < c->glyphUse[victim])
+         victim = slot;
+   }
+   if(victim < 0)
       return -1;
+
+   memcpy(&c->shadow.cgram[victim * LCD1602_GLYPH_SIZE], bitmap, LCD1602_GLYPH_SIZE);
+   c->glyphAllocated |= (1 << victim);
+   c->glyphUse[victim] = ++c->glyphClock;
+   return victim;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Private Helper Functions
+ */
+
+/* Creates a context and brings the panel to a known state, either from power-on or, if "warm",
+   by taking over its current contents (falling back to a full reset if that fails) */
+static lcd1602_t *lcd1602_open(uint8_t i2cAddress, bool backlightOn, const lcd1602_transport *transport,
+   const void *config, bool warm, const lcd1602_snapshot *snapshot)
+{
+   lcd1602_t *c;
+   bool success = false;
+
+   c = (lcd1602_t *) malloc(sizeof(*c));
+   if(NULL == c)
+      return NULL;
+   memset(c, 0, sizeof(*c));
+   c->i2cAddress = i2cAddress;
+   c->backlightOn = backlightOn;
+   c->timing = lcd1602_timing_default;
+   c->transport = transport;
+
+   c->i2c = transport->open(config, i2cAddress, c->timing.busSpeed, LCD1602_I2C_TRANSFER_TIMEOUT, &c->caps);
+   if(NULL == c->i2c)
+   {
+      SERR("[%s] %s transport initialization failed", __func__, transport->name);
+   }
+   else if(0 == c->caps.maxWrite)
+   {
+      SERR("[%s] %s transport reports no write capability", __func__, transport->name);
+      transport->close(c->i2c);
+   }
+   else
+   {
+      c->speedConfirmed = (NULL != transport->set_speed && transport->set_speed(c->i2c, c->timing.busSpeed));
+      c->mutex = sys_mutex_init();
+      if(NULL == c->mutex)
+      {
+         SERR("[%s] mutex low-level initialization failed", __func__);
+      }
+      else
+      {
+         if(warm && lcd1602_attach(c, snapshot) == 0)
+            success = true;
+         else if(lcd1602_reset(c) != 0)
+         {
+            SERR("[%s] lcd1602 reset failed", __func__);
+         }
+         else
+            success = true;
+
+         if(!success)
+            sys_mutex_deinit(c->mutex);
+      }
+
+      if(!success)
+         transport->close(c->i2c);
    }
 
+   if(!success)
+   {
+      free(c);
+      c = NULL;
+   }
+   return c;
+}
+
+/* The backlight is gated while the panel is idle in power-save mode */
+static uint8_t lcd1602_backlight_flag(lcd1602_t *c)
+{
+   return (c->backlightOn && !c->powerIdle) ? LCD1602_FLAG_BACKLIGHT_ON : 0;
+}
+
+/* Writes "data" in as many transfers as the transport's maxWrite requires. The PCF8574 latches each
+   byte on its own, so splitting a frame only lengthens the gaps between bytes. */
+static int lcd1602_transport_write(lcd1602_t *c, const uint8_t *data, uint16_t length)
+{
+   uint16_t offset, chunk;
+
+   for(offset = 0; offset < length; offset += chunk)
+   {
+      chunk = length - offset;
+      if(chunk > c->caps.maxWrite)
+         chunk = c->caps.maxWrite;
+      if(!c->transport->write(c->i2c, &data[offset], chunk))
+         return -1;
+   }
    return 0;
 }
 
-static int lcd1602_write_byte(lcd1602_t *c, uint8_t value, bool isData, uint32_t finalDelay)
+/* Estimated duration of an i2c transfer of "length" data bytes plus the address byte, in microseconds */
+static uint32_t lcd1602_transfer_time(lcd1602_t *c, uint32_t length)
 {
-   uint64_t currentTime = sys_microsecond_tick();
-   int result = -1;
+   return (uint32_t) ((((uint64_t) length + 1) * LCD1602_I2C_BITS_PER_BYTE * 1000000 + c->timing.busSpeed - 1)
+                      / c->timing.busSpeed);
+}
 
-   SDBG("[%s] %s value 0x%02x\n", __func__, (isData) ? "Data" : "Control", value);
+/* Number of idle bytes to insert between two instructions in the same frame. The data setup and
+   enable bytes that begin the next instruction already take two byte times on the bus, which
+   covers the instruction settle time at or below 400 kHz. If the transport didn't confirm the bus
+   speed (e.g. i2c-dev, where the kernel sets the adapter's clock), the padding is sized for the
+   fastest bus the PCF8574 might be driven at. */
+static uint32_t lcd1602_frame_padding(lcd1602_t *c)
+{
+   uint32_t busSpeed = (c->speedConfirmed) ? c->timing.busSpeed : LCD1602_I2C_SPEED_MAX;
+   uint32_t byteTime = LCD1602_I2C_BITS_PER_BYTE * 1000000 / busSpeed;
+   uint32_t needed = (c->timing.settle + byteTime - 1) / ((byteTime > 0) ? byteTime : 1);
+   return (needed > 2) ? needed - 2 : 0;
+}
 
-   sys_mutex_lock(c->mutex);
+/* Sends all queued bytes in a single i2c transfer. The transfer's bus time is accounted for when
+   computing when the next command may begin, which keeps the controller's timing requirements
+   intact even when the low-level driver returns before the transfer completes. */
+int lcd1602_frame_flush(lcd1602_t *c)
+{
+   uint64_t start, currentTime;
+   uint32_t finalDelay = c->frameDelay;
+   uint8_t length = c->frameLength;
+
+   if(0 == length)
+      return 0;
+
+   c->frameLength = 0;
+   c->frameDelay = 0;
+
+   start = sys_microsecond_tick();
+   if(c->busIdle > start)
+      start = c->busIdle; /* queued behind a transfer that's still in progress */
+   /* Each write of a transport with a small maxWrite adds an address byte */
+   c->busIdle = start + lcd1602_transfer_time(c, length + (length - 1) / c->caps.maxWrite);
+
+   if(lcd1602_transport_write(c, c->frame, length) != 0)
+   {
+      SERR("[%s] Failed to transfer %u bytes\n", __func__, length);
+      c->nextCommand = 0;
+      c->busIdle = 0;
+      c->panelValid = false;
+      lcd1602_timing_fallback(c);
+      return -1;
+   }
+
+   /* Don't delay here, defer the delay until the next time an I2C transaction is needed */
+   currentTime = sys_microsecond_tick();
+   c->nextCommand = ((c->busIdle > currentTime) ? c->busIdle : currentTime)
+                  + ((finalDelay < c->timing.settle) ? c->timing.settle : finalDelay);
+   return 0;
+}
+
+/* Waits until the controller is ready for the command that begins the next frame */
+static void lcd1602_frame_begin(lcd1602_t *c)
+{
+   uint64_t currentTime = sys_microsecond_tick();
 
    if(c->nextCommand > currentTime)
    {
@@ -225,23 +737,371 @@ static int lcd1602_write_byte(lcd1602_t *c, uint8_t value, bool isData, uint32_t
       }
       sys_delay_us(delay);
    }
+}
 
-   if(lcd1602_write_nibble(c, (value >> 4) & 0x0f, isData) != 0  /* upper nibble*/
-   || sys_delay_us(LCD1602_DELAY_ENABLE_PULSE_SETTLE) != 0
-   || lcd1602_write_nibble(c, value & 0x0f, isData) != 0)        /* lower nibble */
+/* Queues the lower 4 bits of "value". The data is clocked-in on the falling edge of
+   LCD1602_FLAG_ENABLE; each i2c byte takes far longer than the enable setup and pulse width. */
+static void lcd1602_frame_nibble(lcd1602_t *c, uint8_t value, bool isData)
+{
+   uint8_t data = ((value << 4) & 0xf0)
+                | lcd1602_backlight_flag(c)
+                | ((isData) ? LCD1602_FLAG_RS_DATA : 0); /* if not isData, then control */
+
+   c->frame[c->frameLength++] = data;                        /* data setup */
+   c->frame[c->frameLength++] = data | LCD1602_FLAG_ENABLE;  /* pulse width */
+   c->frame[c->frameLength++] = data;                        /* falling edge */
+}
+
+/* Sends the lower 4 bits of "value" immediately. The caller is responsible for ensuring a delay of
+   the settle time occurs before the next i2c transfer. */
+static int lcd1602_write_nibble(lcd1602_t *c, uint8_t value, bool isData)
+{
+   if(lcd1602_frame_flush(c) != 0)
+      return -1;
+   lcd1602_frame_begin(c);
+   lcd1602_frame_nibble(c, value, isData);
+   return lcd1602_frame_flush(c);
+}
+
+/* Queues a byte in the current frame, applying it to the panel state model. The frame is sent when it
+   fills, when the instruction needs more than the standard settle time, or by an explicit call to
+   lcd1602_frame_flush(). */
+int lcd1602_write_byte(lcd1602_t *c, uint8_t value, bool isData, uint32_t finalDelay)
+{
+   uint32_t padding = lcd1602_frame_padding(c);
+
+   SDBG("[%s] %s value 0x%02x\n", __func__, (isData) ? "Data" : "Control", value);
+
+   if(c->frameLength + padding + LCD1602_FRAME_BYTES_PER_WRITE > LCD1602_MAX_TRANSFER_SIZE
+   && lcd1602_frame_flush(c) != 0)
+      return -1;
+
+   if(0 == c->frameLength)
+      lcd1602_frame_begin(c);
+   else
    {
-      SERR("[%s] Failed to write data\n", __func__);
-      c->nextCommand = 0;
+      uint8_t idle = lcd1602_backlight_flag(c);
+      for(; padding > 0; --padding)
+         c->frame[c->frameLength++] = idle;
+   }
+
+   lcd1602_frame_nibble(c, (value >> 4) & 0x0f, isData); /* upper nibble */
+   lcd1602_frame_nibble(c, value & 0x0f, isData);        /* lower nibble */
+   lcd1602_state_apply(&c->panel, value, isData);
+
+   if(finalDelay > c->timing.settle)
+   {
+      c->frameDelay = finalDelay;
+      return lcd1602_frame_flush(c);
+   }
+   return 0;
+}
+
+/* Reads the busy flag and address counter or, if isData, the byte at the address counter. The
+   PCF8574's outputs are quasi-bidirectional, so D4-D7 are written high to let the controller drive
+   them while the enable line is high. */
+int lcd1602_read_byte(lcd1602_t *c, bool isData, uint8_t *value)
+{
+   uint8_t idle = 0xf0 | LCD1602_FLAG_READ
+                | lcd1602_backlight_flag(c)
+                | ((isData) ? LCD1602_FLAG_RS_DATA : 0);
+   uint8_t strobe[2] = { idle, idle | LCD1602_FLAG_ENABLE };
+   uint8_t high, low;
+   bool success;
+
+   if(!c->caps.read)
+      return -1;
+   if(lcd1602_frame_flush(c) != 0)
+      return -1;
+   lcd1602_frame_begin(c);
+
+   if(c->caps.vectored)
+   {
+      /* One bus transaction, with repeated starts between the segments */
+      lcd1602_transport_segment segments[] = {
+         { strobe, sizeof(strobe), false },
+         { &high, 1, true },
+         { strobe, sizeof(strobe), false },
+         { &low, 1, true },
+         { &idle, 1, false }
+      };
+      success = c->transport->transfer(c->i2c, segments, sizeof(segments) / sizeof(segments[0]));
    }
    else
    {
-      /* Don't delay here, defer the delay until the next time an I2C transaction is needed */
-      c->nextCommand = sys_microsecond_tick()
-                     + ((finalDelay < LCD1602_DELAY_ENABLE_PULSE_SETTLE) ? LCD1602_DELAY_ENABLE_PULSE_SETTLE : finalDelay);
-      result = 0; 
+      success = lcd1602_transport_write(c, strobe, sizeof(strobe)) == 0
+             && c->transport->read(c->i2c, &high, 1)
+             && lcd1602_transport_write(c, strobe, sizeof(strobe)) == 0
+             && c->transport->read(c->i2c, &low, 1)
+             && lcd1602_transport_write(c, &idle, 1) == 0;
+   }
+   if(!success)
+   {
+      SERR("[%s] Read failed\n", __func__);
+      return -1;
+   }
+
+   c->nextCommand = sys_microsecond_tick() + c->timing.settle;
+   *value = (high & 0xf0) | (low >> 4);
+   return 0;
+}
+
+/* Brings the 4-bit interface back in step with a running controller. Whichever nibble the controller
+   expects next, this sequence ends in 4-bit mode, ready for the upper nibble. If a byte was left half
+   written, the first nibble completes it; that may be any instruction ending in 0x3, the slowest of
+   which is return home. */
+int lcd1602_resync(lcd1602_t *c)
+{
+   if(lcd1602_write_nibble(c, 0x03, false) != 0
+   || sys_delay_us(LCD1602_DELAY_HOME) != 0
+   || lcd1602_write_nibble(c, 0x03, false) != 0
+   || lcd1602_write_nibble(c, 0x03, false) != 0   /* 8-bit mode */
+   || lcd1602_write_nibble(c, 0x02, false) != 0   /* 4-bit mode */
+   || lcd1602_write_byte(c, LCD1602_CMD_FUNCTION_SET | FLAG_FUNCTION_SET_LINES_2, false, 0) != 0)
+      return -1;
+   return 0;
+}
+
+/* Takes over a panel that's already initialized, without clearing it. The panel is assumed to hold
+   "snapshot"; if that's NULL, the display contents are read back. */
+static int lcd1602_attach(lcd1602_t *c, const lcd1602_snapshot *snapshot)
+{
+   uint8_t index;
+
+   sys_mutex_lock(c->mutex);
+
+   if(lcd1602_resync(c) != 0)
+   {
+      sys_mutex_unlock(c->mutex);
+      return -1;
+   }
+
+   /* The display shift and address counter can't be read back, and an interrupted byte may have
+      changed them, so return home to put them in a known state. The slow power-on delays for the
+      mode instructions aren't needed once the controller is running. */
+   lcd1602_state_reset(&c->panel);
+   if(NULL != snapshot)
+   {
+      c->panel.entryMode = snapshot->entryMode & (LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT
+                                                  | LCD1602_ENTRY_MODE_SET_FLAG_SHIFT);
+      c->panel.displayControl = snapshot->displayControl & (LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY
+                                                            | LCD1602_DISPLAY_CONTROL_FLAG_CURSOR
+                                                            | LCD1602_DISPLAY_CONTROL_FLAG_BLINK);
+   }
+   if(lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | c->panel.entryMode, false, 0) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL | c->panel.displayControl, false, 0) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_HOME, false, c->timing.clear) != 0)
+   {
+      sys_mutex_unlock(c->mutex);
+      return -1;
+   }
+
+   memcpy(&c->shadow, &c->panel, sizeof(c->shadow));
+   c->panelValid = true;
+   c->glyphReserved = 0;
+   c->glyphAllocated = 0;
+
+   if(NULL != snapshot)
+   {
+      memcpy(c->panel.ddram, snapshot->ddram, sizeof(c->panel.ddram));
+      memcpy(c->panel.cgram, snapshot->cgram, sizeof(c->panel.cgram));
+      c->panelGlyphs = snapshot->glyphs;
+      memcpy(&c->shadow, &c->panel, sizeof(c->shadow));
+      c->shadow.displayShift = snapshot->displayShift % LCD1602_DDRAM_LINE_LENGTH;
+      c->shadow.cgramSelected = (0 != snapshot->cgramSelected);
+      c->shadow.address = snapshot->address % ((c->shadow.cgramSelected) ? LCD1602_CGRAM_SIZE : LCD1602_DDRAM_SIZE);
+   }
+   else
+   {
+      /* Custom characters on screen are left alone (lcd1602_glyph() won't evict a displayed slot),
+         so only the DDRAM is read back */
+      c->panelGlyphs = 0;
+      if(lcd1602_write_byte(c, LCD1602_CMD_SET_DDRAM_ADDR, false, 0) != 0)
+         c->panelValid = false;
+      for(index = 0; index < LCD1602_DDRAM_SIZE && c->panelValid; ++index)
+      {
+         if(lcd1602_read_byte(c, true, &c->panel.ddram[index]) != 0)
+            c->panelValid = false;
+      }
+      /* Reads advance the address counter, which the state model doesn't track */
+      if(c->panelValid && lcd1602_write_byte(c, LCD1602_CMD_SET_DDRAM_ADDR, false, 0) != 0)
+         c->panelValid = false;
+      memcpy(c->shadow.ddram, c->panel.ddram, sizeof(c->shadow.ddram));
+   }
+
+   if(!c->panelValid || lcd1602_sync(c) != 0)
+   {
+      SERR("[%s] Failed to attach; panel will be reset\n", __func__);
+      sys_mutex_unlock(c->mutex);
+      return -1;
    }
 
    sys_mutex_unlock(c->mutex);
+   return 0;
+}
 
-   return result; 
+/* A visible cursor or blinking block shows where the address counter is */
+static bool lcd1602_cursor_visible(lcd1602_state_t *s)
+{
+   return (s->displayControl & LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY)
+       && (s->displayControl & (LCD1602_DISPLAY_CONTROL_FLAG_CURSOR | LCD1602_DISPLAY_CONTROL_FLAG_BLINK));
+}
+
+/* Moves the panel's address counter, unless it's already there */
+static int lcd1602_seek(lcd1602_t *c, bool cgramSelected, uint8_t address)
+{
+   uint8_t command;
+
+   if(c->panel.cgramSelected == cgramSelected && c->panel.address == address)
+      return 0;
+   command = (cgramSelected) ? (LCD1602_CMD_SET_CGRAM_ADDR | address)
+                             : (LCD1602_CMD_SET_DDRAM_ADDR | lcd1602_ddram_address(address));
+   return lcd1602_write_byte(c, command, false, 0);
+}
+
+/* Caller must hold c->mutex. The request is applied to the shadow state; in direct mode it's also
+   queued for the panel, while in write-behind mode it waits for the next lcd1602_flush().
+
+   In direct mode, a request that leaves the panel's contents and modes unchanged (a cursor move, or
+   rewriting a character with the same value) isn't sent. The panel's address counter is left behind
+   and only caught up by the next data write that needs it, so a set-cursor that the following
+   writes would have reached anyway costs nothing. */
+static int lcd1602_request_locked(lcd1602_t *c, uint8_t value, bool isData, uint32_t delay)
+{
+   bool cgramSelected = c->shadow.cgramSelected;
+   uint8_t address = c->shadow.address;
+
+   lcd1602_state_apply(&c->shadow, value, isData);
+   if(c->writeBehind)
+   {
+      lcd1602_mark_pending(c);
+      return 0;
+   }
+
+   if(!c->panelValid || !lcd1602_state_equal(&c->panel, &c->shadow, true))
+   {
+      if(isData && lcd1602_seek(c, cgramSelected, address) != 0)
+         return -1;
+      if(lcd1602_write_byte(c, value, isData, delay) != 0)
+         return -1;
+   }
+
+   /* A deferred address can't be hidden from the user while the cursor shows it */
+   if(lcd1602_cursor_visible(&c->panel))
+      return lcd1602_seek(c, c->shadow.cgramSelected, c->shadow.address);
+   return 0;
+}
+
+static int lcd1602_request(lcd1602_t *c, uint8_t value, bool isData, uint32_t delay)
+{
+   int result;
+   sys_mutex_lock(c->mutex);
+   result = lcd1602_request_locked(c, value, isData, delay);
+   if(0 == result)
+      result = lcd1602_frame_flush(c);
+   sys_mutex_unlock(c->mutex);
+   return result;
+}
+
+/* Caller must hold c->mutex. Sends the minimum set of instructions that make the panel match the
+   shadow state. Only cells whose value differs are written, so intermediate values that were
+   overwritten in the shadow before this call never reach the bus. */
+int lcd1602_sync(lcd1602_t *c)
+{
+   lcd1602_state_t *p = &c->panel;
+   lcd1602_state_t *s = &c->shadow;
+   uint8_t index, slot, dirtyGlyphs = 0;
+   bool woken;
+
+   /* Sending anything ends an idle period; the display control is restored below, after the cells,
+      and always sent so that the backlight is switched back on */
+   woken = c->powerIdle;
+   c->pendingChanges = false;
+   c->powerIdle = false;
+
+   if(!c->panelValid)
+   {
+      /* Contents are unknown; start over from a blank display */
+      if(lcd1602_write_byte(c, LCD1602_CMD_CLEAR, false, c->timing.clear) != 0)
+         return -1;
+      c->panelValid = true;
+   }
+
+   for(slot = 0; slot < LCD1602_CGRAM_SLOTS; ++slot)
+   {
+      if(!(c->panelGlyphs & (1 << slot))
+      || memcmp(&p->cgram[slot * LCD1602_GLYPH_SIZE], &s->cgram[slot * LCD1602_GLYPH_SIZE],
+                LCD1602_GLYPH_SIZE) != 0)
+         dirtyGlyphs |= (1 << slot);
+   }
+
+   /* Only slots the application or a renderer has defined are worth sending */
+   dirtyGlyphs &= (c->glyphReserved | c->glyphAllocated);
+
+   if(0 != dirtyGlyphs || memcmp(p->ddram, s->ddram, sizeof(p->ddram)) != 0)
+   {
+      /* Write changed glyphs and cells without moving the display. The requested entry mode
+         is restored below. */
+      if(p->entryMode != LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT
+      && lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                            false, c->timing.modeSet) != 0)
+         return -1;
+
+      for(slot = 0; slot < LCD1602_CGRAM_SLOTS; ++slot)
+      {
+         if(!(dirtyGlyphs & (1 << slot)))
+            continue;
+         for(index = slot * LCD1602_GLYPH_SIZE; index < (slot + 1) * LCD1602_GLYPH_SIZE; ++index)
+         {
+            if((c->panelGlyphs & (1 << slot)) && p->cgram[index] == s->cgram[index])
+               continue;
+            if(lcd1602_yield(c) != 0 || lcd1602_seek(c, true, index) != 0)
+               return -1;
+            if(lcd1602_write_byte(c, s->cgram[index], true, 0) != 0)
+               return -1;
+         }
+         c->panelGlyphs |= (1 << slot);
+      }
+
+      for(index = 0; index < LCD1602_DDRAM_SIZE; ++index)
+      {
+         if(p->ddram[index] == s->ddram[index])
+            continue;
+         if(lcd1602_yield(c) != 0 || lcd1602_seek(c, false, index) != 0)
+            return -1;
+         if(lcd1602_write_byte(c, s->ddram[index], true, 0) != 0)
+            return -1;
+      }
+   }
+
+   /* Return home resets the shift in one (slow) instruction, which beats a long run of shifts */
+   if(0 == s->displayShift
+   && p->displayShift >= LCD1602_HOME_SHIFT_THRESHOLD
+   && p->displayShift <= LCD1602_DDRAM_LINE_LENGTH - LCD1602_HOME_SHIFT_THRESHOLD
+   && lcd1602_write_byte(c, LCD1602_CMD_HOME, false, c->timing.clear) != 0)
+      return -1;
+
+   while(p->displayShift != s->displayShift)
+   {
+      bool left = ((s->displayShift + LCD1602_DDRAM_LINE_LENGTH - p->displayShift)
+                   % LCD1602_DDRAM_LINE_LENGTH) <= LCD1602_DDRAM_LINE_LENGTH / 2;
+      if(lcd1602_write_byte(c, LCD1602_CMD_SHIFT | LCD1602_SHIFT_FLAG_DISPLAY
+                             | ((left) ? 0 : LCD1602_SHIFT_FLAG_RIGHT), false, 0) != 0)
+         return -1;
+   }
+
+   if(p->entryMode != s->entryMode
+   && lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | s->entryMode, false, c->timing.modeSet) != 0)
+      return -1;
+
+   if((woken || p->displayControl != s->displayControl)
+   && lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL | s->displayControl,
+                         false, c->timing.modeSet) != 0)
+      return -1;
+
+   /* Otherwise the address is caught up by the next data write that needs it */
+   if(lcd1602_cursor_visible(s) && lcd1602_seek(c, s->cgramSelected, s->address) != 0)
+      return -1;
+
+   return lcd1602_frame_flush(c);
 }
@@ -8,15 +8,73 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "lcd1602.h"
+#include "lcd1602_protocol.h"
 #include "sys.h"
 
+#define LCD1602_DDRAM_LINE_LENGTH  40
+#define LCD1602_DDRAM_SIZE         (2 * LCD1602_DDRAM_LINE_LENGTH)
+#define LCD1602_CGRAM_SIZE         64
+#define LCD1602_GLYPH_SIZE         8  /* bytes per CGRAM character (5x8 font) */
+#define LCD1602_CHAR_FULL_BLOCK    0xff
+#define LCD1602_CHARSET_COUNT      2
+#define LCD1602_UTF8_INVALID       0xfffd
+#define LCD1602_YIELD_POLL_INTERVAL 100 /* microseconds between checks while urgent writes run */
+
+/* Model of the HD44780 registers and memory that affect what is shown on the panel */
+typedef struct lcd1602_state_s
+{
+    uint8_t ddram[LCD1602_DDRAM_SIZE]; /* both DDRAM lines, indexed by lcd1602_ddram_index() */
+    uint8_t cgram[LCD1602_CGRAM_SIZE];
+    uint8_t address;        /* address counter; DDRAM index, or CGRAM address if cgramSelected */
+    bool cgramSelected;
+    uint8_t entryMode;      /* LCD1602_ENTRY_MODE_SET_FLAG_* */
+    uint8_t displayControl; /* LCD1602_DISPLAY_CONTROL_FLAG_* */
+    uint8_t displayShift;   /* number of columns the display is shifted left */
+} lcd1602_state_t;
+
 typedef struct lcd1602_s
 {
     uint8_t i2cAddress;
     bool backlightOn;
     uint64_t nextCommand; /* microsecond tick count when next command may begin */
-    i2c_lowlevel_context i2c;
+    const lcd1602_transport *transport;
+    void *i2c;                   /* transport handle */
+    lcd1602_transport_caps caps;
     mutex_lowlevel mutex;
+    lcd1602_timing timing; /* bus speed and instruction delays in use */
+    bool speedConfirmed;   /* the transport set timing.busSpeed; if not, the bus may be faster */
+    uint32_t urgentPending; /* urgent writers waiting for the mutex; accessed atomically */
+
+    /* PCF8574 bytes queued for a single i2c transfer */
+    uint8_t frame[LCD1602_MAX_TRANSFER_SIZE];
+    uint8_t frameLength;
+    uint32_t frameDelay;  /* microseconds the last instruction in the frame needs to complete */
+    uint64_t busIdle;     /* estimated microsecond tick count when the last transfer finishes */
+
+    lcd1602_state_t panel;  /* what the controller currently holds */
+    lcd1602_state_t shadow; /* what the application has requested */
+    bool panelValid;        /* false if a failed transfer left the controller in an unknown state */
+
+    bool writeBehind;       /* if set, requests only update shadow until lcd1602_flush() */
+    uint64_t frameInterval; /* minimum microseconds between write-behind frames */
+    uint64_t nextFrame;     /* microsecond tick count when the next write-behind frame may be sent */
+    bool pendingChanges;    /* write-behind changes made since the last sync */
+
+    bool powerSave;         /* write-behind frames are batched, see lcd1602_set_power_save() */
+    bool powerIdle;         /* display and backlight switched off until the next change */
+    bool powerSaveResume;   /* writeBehind to return to when power saving is disabled */
+    uint64_t batchStart;    /* microsecond tick count of the first change not yet sent */
+    uint64_t batchWindow;   /* microseconds changes are collected before being sent */
+    uint64_t idleTimeout;   /* microseconds without changes before going idle; 0 for never */
+    uint64_t lastActivity;  /* microsecond tick count of the last change sent */
+
+    uint8_t panelGlyphs;    /* bit per CGRAM slot whose contents on the panel are known */
+    uint8_t glyphReserved;  /* bit per CGRAM slot defined by lcd1602_define_char() */
+    uint8_t glyphAllocated; /* bit per CGRAM slot holding a cached glyph */
+    uint32_t glyphUse[LCD1602_CGRAM_SLOTS]; /* last use of each cached glyph, for eviction */
+    uint32_t glyphClock;
+
+    eLCD1602Charset charset; /* character ROM fitted to the panel */
 } lcd1602_t;
 
 int lcd1602_ll_init(lcd1602_t *ctx, i2c_lowlevel_config *config);
@@ -25,4 +83,32 @@ int lcd1602_ll_mutex_lock(lcd1602_t *ctx);
 int lcd1602_ll_mutex_unlock(lcd1602_t *ctx);
 uint64_t lcd1602_ll_microsecond_tick(lcd1602_t *ctx);
 
+/* lcd1602.c; caller must hold ctx->mutex */
+int lcd1602_glyph(lcd1602_t *ctx, const uint8_t *bitmap);
+int lcd1602_update(lcd1602_t *ctx);
+int lcd1602_yield(lcd1602_t *ctx);
+void lcd1602_mark_pending(lcd1602_t *ctx);
+int lcd1602_sync(lcd1602_t *ctx);
+int lcd1602_resync(lcd1602_t *ctx);
+int lcd1602_frame_flush(lcd1602_t *ctx);
+int lcd1602_write_byte(lcd1602_t *ctx, uint8_t value, bool isData, uint32_t finalDelay);
+int lcd1602_read_byte(lcd1602_t *ctx, bool isData, uint8_t *value);
+
+/* timing.c */
+extern const lcd1602_timing lcd1602_timing_default;
+void lcd1602_timing_fallback(lcd1602_t *ctx); /* caller must hold ctx->mutex */
+
+/* charset.c */
+int lcd1602_charset_code(eLCD1602Charset charset, uint32_t codepoint);
+const uint8_t *lcd1602_charset_glyph(uint32_t codepoint);
+uint32_t lcd1602_utf8_decode(const char **s);
+
+/* state.c */
+int lcd1602_cell_index(uint16_t row, uint16_t column);
+uint8_t lcd1602_ddram_index(uint8_t address);
+uint8_t lcd1602_ddram_address(uint8_t index);
+void lcd1602_state_reset(lcd1602_state_t *s);
+void lcd1602_state_apply(lcd1602_state_t *s, uint8_t value, bool isData);
+bool lcd1602_state_equal(const lcd1602_state_t *a, const lcd1602_state_t *b, bool ignoreAddress);
+
 #endif /* _LCD1602_PRIVATE_H */
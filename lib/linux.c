@@ -5,22 +5,21 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <string.h> /* strdup */
-#include <fcntl.h> /* open/close */
+#include <string.h>
 #include <time.h> /* clock_gettime */
-#include <sys/ioctl.h>
 #include <pthread.h>
 #include <linux/i2c.h>
-#include <linux/i2c-dev.h>
 #include "sys_linux.h"
 #include "sys.h"
 #include "helpers.h"
+#include "virtual.h"
+#include "i2cdev.h"
 
 typedef struct linux_rtci2c_s
 {
-    char *device;
-    int handle;
-    uint32_t timeout;
+    i2cdev_t *i2cdev;
+    lcd1602_transport_caps caps;   /* of the i2c-dev adapter */
+    virtual_panel_t *virtualPanel; /* if set, replaces the i2c device */
 } linux_i2c_t;
 
 typedef struct linux_mutex_s
@@ -32,46 +31,35 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
                                           i2c_lowlevel_config *config)
 {
    linux_i2c_t *l;
-   int result = -1;
 
-   l = (linux_i2c_t *) malloc(sizeof(*l));
+   if(NULL == config)
+   {
+      SERR("[%s] Missing configuration", __func__);
+      return NULL;
+   }
+   l = (linux_i2c_t *) calloc(1, sizeof(*l));
    if(NULL == l)
    {
       SERR("[%s] Failed to allocate low-level structure", __func__);
       return NULL;
    }
 
-   l->handle = -1;
-   l->timeout = i2c_timeout_ms;
-   l->device = strdup(config->device);
-   if(NULL == l->device)
-   {
-      SERR("[%s] Memory allocation error", __func__);
-   }
-   else
+   if(virtual_device(config->device))
    {
-      l->handle = open(l->device, O_RDWR);
-      if(l->handle < 0)
-      {
-         SERR("[%s] Failed to open device '%s'", __func__, l->device);
-      }
-      else if(ioctl(l->handle, I2C_SLAVE, i2c_address) < 0)
+      l->virtualPanel = virtual_init(i2c_speed, config);
+      if(NULL == l->virtualPanel)
       {
-         SERR("[%s] Failed to set I2C slave address to 0x%02x", __func__, i2c_address);
+         SERR("[%s] Failed to create virtual panel '%s'", __func__, config->device);
       }
-      else
-         result = 0;
    }
+   else
+      l->i2cdev = i2cdev_init(config->device, i2c_address, i2c_timeout_ms, &l->caps);
 
-   if(0 != result)
+   if(NULL == l->virtualPanel && NULL == l->i2cdev)
    {
-      if(l->handle >= 0)
-         close(l->handle);
       free(l);
       l = NULL;
    }
-
-   SERR("[%s] result %d", __func__, result);
    return (i2c_lowlevel_context) l;
 }
 
@@ -81,10 +69,10 @@ bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
    if(NULL == l)
       return true;
 
-   if(l->handle >= 0)
-      close(l->handle);
-   if(NULL != l->device)
-      free(l->device);
+   if(NULL != l->i2cdev)
+      i2cdev_deinit(l->i2cdev);
+   if(NULL != l->virtualPanel)
+      virtual_deinit(l->virtualPanel);
    free(l);
 
    return true;
@@ -93,7 +81,6 @@ bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
 bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   struct i2c_smbus_ioctl_data args;
    union i2c_smbus_data smdata;
    int result = -EINVAL;
 
@@ -101,15 +88,11 @@ bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *d
    {
       SERR("[%s] Data length overflow (%u bytes)", __func__, length);
    }
-   else
+   else if(NULL != l->i2cdev)
    {
       smdata.block[0] = length;
       memcpy(&smdata.block[1], data, length);
-      args.read_write = I2C_SMBUS_WRITE;
-      args.command = reg;
-      args.size = I2C_SMBUS_I2C_BLOCK_DATA;
-      args.data = &smdata; 
-      result = ioctl(l->handle, I2C_SMBUS, &args);
+      result = i2cdev_smbus(l->i2cdev, I2C_SMBUS_WRITE, reg, I2C_SMBUS_I2C_BLOCK_DATA, &smdata);
       if(0 == result)
       {
          SDBG("[%s] Success (%u bytes)", __func__, length);
@@ -121,24 +104,29 @@ bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *d
    return false;
 }
 
+/* Writes in pieces no longer than the adapter accepts; the PCF8574 latches each byte on its own */
 bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   int result = write(l->handle, data, length);
-   if(length == result)
+   uint16_t offset, chunk;
+
+   if(NULL != l->virtualPanel)
+      return virtual_write(l->virtualPanel, data, length);
+
+   for(offset = 0; offset < length; offset += chunk)
    {
-      SDBG("[%s] Success (%u bytes)", __func__, length);
-      return true;
+      chunk = length - offset;
+      if(chunk > l->caps.maxWrite)
+         chunk = l->caps.maxWrite;
+      if(!i2cdev_write(l->i2cdev, &data[offset], chunk))
+         return false;
    }
-
-   SERR("[%s] Failed (result %d, errno %d)", __func__, result, errno);
-   return false;
+   return true;
 }
 
 bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   struct i2c_smbus_ioctl_data args;
    union i2c_smbus_data smdata;
    int result = -EINVAL;
 
@@ -146,14 +134,10 @@ bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *da
    {
       SERR("[%s] Data length overflow (%u bytes)", __func__, length);
    }
-   else
+   else if(NULL != l->i2cdev)
    {
       smdata.block[0] = length;
-      args.read_write = I2C_SMBUS_READ;
-      args.command = reg;
-      args.size = I2C_SMBUS_I2C_BLOCK_DATA; 
-      args.data = &smdata; 
-      result = ioctl(l->handle, I2C_SMBUS, &args);
+      result = i2cdev_smbus(l->i2cdev, I2C_SMBUS_READ, reg, I2C_SMBUS_I2C_BLOCK_DATA, &smdata);
       if(0 == result)
       {
          SDBG("[%s] Success (%u bytes)", __func__, length);
@@ -163,22 +147,26 @@ bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *da
    }
 
    SERR("[%s] Failed (result %d, errno %d)", __func__, result, errno);
-   memset(&smdata.block[1], 0, length);
+   memset(data, 0, length);
    return false;
 }
 
 bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   int result = read(l->handle, data, length);
-   if(length == result)
-   {
-      SDBG("[%s] Success (%u bytes)", __func__, length);
-      return true; 
-   }
 
-   SERR("[%s] Failed (result %d, errno %d)", __func__, result, errno);
-   memset(data,  0, length);
+   if(NULL != l->virtualPanel)
+      return virtual_read(l->virtualPanel, data, length);
+   return i2cdev_read(l->i2cdev, data, length);
+}
+
+/* The i2c-dev interface can't change the adapter's clock, which is set by the kernel (e.g. the device
+   tree's clock-frequency), so speed changes are refused rather than merely assumed */
+bool SYS_WEAK i2c_ll_set_speed(i2c_lowlevel_context ctx, uint32_t i2c_speed)
+{
+   linux_i2c_t *l = (linux_i2c_t *) ctx;
+   if(NULL != l->virtualPanel)
+      return virtual_set_speed(l->virtualPanel, i2c_speed);
    return false;
 }
 
@@ -214,6 +202,11 @@ bool SYS_WEAK sys_mutex_unlock(mutex_lowlevel mutex)
    return true;
 }
 
+int SYS_WEAK sys_delay_us(size_t x)
+{
+   return usleep(x);
+}
+
 uint64_t SYS_WEAK sys_microsecond_tick(void)
 {
    struct timespec ts;
@@ -0,0 +1,132 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 scrolling log views
+ */
+#include <malloc.h>
+#include <string.h>
+#include "lcd1602_protocol.h"
+#include "lcd1602_private.h"
+#include "helpers.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+typedef struct lcd1602_log_s
+{
+   uint16_t row;           /* panel rows the view occupies */
+   uint16_t rows;
+   uint16_t columns;
+   uint16_t history;       /* lines kept */
+   uint16_t count;         /* lines appended, up to history */
+   uint16_t newest;        /* ring index of the newest line */
+   uint16_t offset;        /* first column shown */
+   uint64_t frameInterval; /* minimum microseconds between renders */
+   uint64_t nextFrame;
+   char *lines;            /* history lines of LCD1602_LOG_LINE_LENGTH characters, space padded */
+} lcd1602_log_t;
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+lcd1602_log lcd1602_log_create(uint16_t row, uint16_t rows, uint16_t columns, uint16_t history,
+   uint32_t maxFps)
+{
+   lcd1602_log_t *l;
+
+   if(0 == rows || 0 == columns || history < rows
+   || lcd1602_cell_index(row + rows - 1, columns - 1) < 0)
+   {
+      SERR("[%s] Unsupported log view %ux%u at row %u", __func__, rows, columns, row);
+      return NULL;
+   }
+
+   l = (lcd1602_log_t *) malloc(sizeof(*l));
+   if(NULL == l)
+      return NULL;
+   memset(l, 0, sizeof(*l));
+   l->lines = (char *) malloc((size_t) history * LCD1602_LOG_LINE_LENGTH);
+   if(NULL == l->lines)
+   {
+      free(l);
+      return NULL;
+   }
+   l->row = row;
+   l->rows = rows;
+   l->columns = columns;
+   l->history = history;
+   l->frameInterval = (maxFps > 0) ? (1000000 / maxFps) : 0;
+   return (lcd1602_log) l;
+}
+
+void lcd1602_log_destroy(lcd1602_log log)
+{
+   lcd1602_log_t *l = (lcd1602_log_t *) log;
+   if(NULL == l)
+      return;
+   free(l->lines);
+   free(l);
+}
+
+int lcd1602_log_append(lcd1602_log log, const char *line)
+{
+   lcd1602_log_t *l = (lcd1602_log_t *) log;
+   char *slot;
+   uint16_t length;
+
+   l->newest = (l->newest + 1) % l->history;
+   if(l->count < l->history)
+      ++l->count;
+
+   slot = &l->lines[(size_t) l->newest * LCD1602_LOG_LINE_LENGTH];
+   for(length = 0; length < LCD1602_LOG_LINE_LENGTH && line[length] != '\0' && line[length] != '\n'; ++length)
+      slot[length] = line[length];
+   memset(&slot[length], ' ', LCD1602_LOG_LINE_LENGTH - length);
+   return 0;
+}
+
+int lcd1602_log_set_offset(lcd1602_log log, uint16_t column)
+{
+   lcd1602_log_t *l = (lcd1602_log_t *) log;
+
+   if(column >= LCD1602_LOG_LINE_LENGTH)
+      return -1;
+   l->offset = column;
+   return 0;
+}
+
+/* The view is copied into the shadow state, so only the cells that differ from what the panel shows
+   are sent; scrolling a line up costs only the characters that differ from the line below it. The
+   view is copied even when no lines were appended, since other updates may have overwritten it. */
+int lcd1602_log_show(lcd1602_context context, lcd1602_log log)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   lcd1602_log_t *l = (lcd1602_log_t *) log;
+   uint64_t currentTime = sys_microsecond_tick();
+   uint16_t r, column;
+   int result;
+
+   if(currentTime < l->nextFrame)
+      return 0; /* lines appended meanwhile are shown by a later call */
+
+   sys_mutex_lock(c->mutex);
+   for(r = 0; r < l->rows; ++r)
+   {
+      /* The newest line is at the bottom */
+      uint16_t age = l->rows - 1 - r;
+      const char *line = NULL;
+
+      if(age < l->count)
+         line = &l->lines[(size_t) ((l->newest + l->history - age) % l->history) * LCD1602_LOG_LINE_LENGTH];
+      for(column = 0; column < l->columns; ++column)
+      {
+         uint16_t position = l->offset + column;
+         c->shadow.ddram[lcd1602_cell_index(l->row + r, column)] =
+            (NULL != line && position < LCD1602_LOG_LINE_LENGTH) ? (uint8_t) line[position] : ' ';
+      }
+   }
+   result = lcd1602_update(c);
+   sys_mutex_unlock(c->mutex);
+
+   l->nextFrame = currentTime + l->frameInterval;
+   return result;
+}
@@ -0,0 +1,226 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 bar graph and large character rendering
+ */
+#include <string.h>
+#include "lcd1602_protocol.h"
+#include "lcd1602_private.h"
+#include "helpers.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+#define LCD1602_GLYPH_COLUMNS     5  /* pixel columns per character */
+#define LCD1602_BIG_WIDTH         3  /* columns per large character */
+#define LCD1602_BIG_GLYPHS        3  /* maximum custom glyphs used by a large font */
+
+/* Cell codes used in the font tables below. Values less than LCD1602_BIG_GLYPHS refer to entries of
+   the font's glyph list, which are mapped onto CGRAM slots at render time. */
+#define BIG_SPACE  0xfe
+#define BIG_FULL   0xff
+
+/* -----------------------------------------------------------------------------------------------------------
+ * 2-row font: top bar, bottom bar, and top+bottom bars combined with full blocks
+ */
+
+#define B2_TOP     0
+#define B2_BOTTOM  1
+#define B2_BOTH    2
+
+static const uint8_t big2_glyphs[LCD1602_BIG_GLYPHS][LCD1602_GLYPH_SIZE] = {
+   { 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* B2_TOP */
+   { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f }, /* B2_BOTTOM */
+   { 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x1f, 0x1f, 0x1f }, /* B2_BOTH */
+};
+
+static const uint8_t big2_digits[10][2][LCD1602_BIG_WIDTH] = {
+   { { BIG_FULL,  B2_TOP,    BIG_FULL  }, { BIG_FULL,  B2_BOTTOM, BIG_FULL  } }, /* 0 */
+   { { B2_TOP,    BIG_FULL,  BIG_SPACE }, { B2_BOTTOM, BIG_FULL,  B2_BOTTOM } }, /* 1 */
+   { { B2_BOTH,   B2_BOTH,   BIG_FULL  }, { BIG_FULL,  B2_BOTTOM, B2_BOTTOM } }, /* 2 */
+   { { B2_BOTH,   B2_BOTH,   BIG_FULL  }, { B2_BOTTOM, B2_BOTTOM, BIG_FULL  } }, /* 3 */
+   { { BIG_FULL,  B2_BOTTOM, BIG_FULL  }, { BIG_SPACE, BIG_SPACE, BIG_FULL  } }, /* 4 */
+   { { BIG_FULL,  B2_BOTH,   B2_BOTH   }, { B2_BOTTOM, B2_BOTTOM, BIG_FULL  } }, /* 5 */
+   { { BIG_FULL,  B2_BOTH,   B2_BOTH   }, { BIG_FULL,  B2_BOTTOM, BIG_FULL  } }, /* 6 */
+   { { B2_TOP,    B2_TOP,    BIG_FULL  }, { BIG_SPACE, BIG_SPACE, BIG_FULL  } }, /* 7 */
+   { { BIG_FULL,  B2_BOTH,   BIG_FULL  }, { BIG_FULL,  B2_BOTTOM, BIG_FULL  } }, /* 8 */
+   { { BIG_FULL,  B2_BOTH,   BIG_FULL  }, { B2_BOTTOM, B2_BOTTOM, BIG_FULL  } }, /* 9 */
+};
+
+static const uint8_t big2_minus[2][LCD1602_BIG_WIDTH] = {
+   { B2_BOTTOM, B2_BOTTOM, B2_BOTTOM }, { BIG_SPACE, BIG_SPACE, BIG_SPACE }
+};
+
+/* -----------------------------------------------------------------------------------------------------------
+ * 4-row font: 3x8 half-block bitmaps (bit 2 is the left column), drawn with upper and lower half blocks
+ */
+
+#define B4_UPPER   0
+#define B4_LOWER   1
+
+static const uint8_t big4_glyphs[LCD1602_BIG_GLYPHS][LCD1602_GLYPH_SIZE] = {
+   { 0x1f, 0x1f, 0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00 }, /* B4_UPPER */
+   { 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f, 0x1f }, /* B4_LOWER */
+   { 0 }
+};
+
+static const uint8_t big4_digits[10][8] = {
+   { 7, 5, 5, 5, 5, 5, 5, 7 }, /* 0 */
+   { 2, 6, 2, 2, 2, 2, 2, 7 }, /* 1 */
+   { 7, 1, 1, 7, 4, 4, 4, 7 }, /* 2 */
+   { 7, 1, 1, 7, 1, 1, 1, 7 }, /* 3 */
+   { 5, 5, 5, 7, 1, 1, 1, 1 }, /* 4 */
+   { 7, 4, 4, 7, 1, 1, 1, 7 }, /* 5 */
+   { 7, 4, 4, 7, 5, 5, 5, 7 }, /* 6 */
+   { 7, 1, 1, 1, 1, 1, 1, 1 }, /* 7 */
+   { 7, 5, 5, 7, 5, 5, 5, 7 }, /* 8 */
+   { 7, 5, 5, 7, 1, 1, 1, 7 }, /* 9 */
+};
+
+static const uint8_t big4_minus[8] = { 0, 0, 0, 7, 0, 0, 0, 0 };
+
+static uint8_t big4_cell(const uint8_t *bitmap, uint16_t row, uint16_t column)
+{
+   uint8_t mask = 1 << (LCD1602_BIG_WIDTH - 1 - column);
+   bool upper = (bitmap[row * 2] & mask) != 0;
+   bool lower = (bitmap[row * 2 + 1] & mask) != 0;
+
+   if(upper && lower)
+      return BIG_FULL;
+   if(upper)
+      return B4_UPPER;
+   if(lower)
+      return B4_LOWER;
+   return BIG_SPACE;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+int lcd1602_bar(lcd1602_context context, uint16_t row, uint16_t column, uint16_t width,
+   uint32_t value, uint32_t maximum)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   uint32_t pixels, cell;
+   int index, result;
+
+   if(0 == width || lcd1602_cell_index(row, column) < 0 || lcd1602_cell_index(row, column + width - 1) < 0)
+      return -1;
+
+   if(value > maximum)
+      value = maximum;
+   pixels = (0 == maximum) ? 0 : (uint32_t) (((uint64_t) value * width * LCD1602_GLYPH_COLUMNS) / maximum);
+
+   sys_mutex_lock(c->mutex);
+
+   index = lcd1602_cell_index(row, column);
+   for(cell = 0; cell < width; ++cell)
+   {
+      uint32_t fill = (pixels > LCD1602_GLYPH_COLUMNS) ? LCD1602_GLYPH_COLUMNS : pixels;
+      uint8_t code = ' ';
+
+      if(LCD1602_GLYPH_COLUMNS == fill)
+         code = LCD1602_CHAR_FULL_BLOCK;
+      else if(fill > 0)
+      {
+         uint8_t bitmap[LCD1602_GLYPH_SIZE];
+         int slot;
+
+         memset(bitmap, (0x1f << (LCD1602_GLYPH_COLUMNS - fill)) & 0x1f, sizeof(bitmap));
+         slot = lcd1602_glyph(c, bitmap);
+         if(slot >= 0)
+            code = (uint8_t) slot;
+         else if(fill * 2 >= LCD1602_GLYPH_COLUMNS)
+            code = LCD1602_CHAR_FULL_BLOCK; /* no free slot; round to the nearest whole cell */
+      }
+      c->shadow.ddram[index + cell] = code;
+      pixels -= fill;
+   }
+
+   result = lcd1602_update(c);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_big_string(lcd1602_context context, uint16_t row, uint16_t column, uint16_t height,
+   const char *s)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   const uint8_t (*glyphs)[LCD1602_GLYPH_SIZE];
+   uint8_t slots[LCD1602_BIG_GLYPHS];
+   uint16_t glyphCount, r, col, count, length = strlen(s);
+   int result;
+
+   if(2 == height)
+   {
+      glyphs = big2_glyphs;
+      glyphCount = 3;
+   }
+   else if(4 == height)
+   {
+      glyphs = big4_glyphs;
+      glyphCount = 2;
+   }
+   else
+      return -1;
+
+   if(0 == length)
+      return 0;
+   if(lcd1602_cell_index(row + height - 1, column + length * (LCD1602_BIG_WIDTH + 1) - 2) < 0)
+      return -1;
+
+   sys_mutex_lock(c->mutex);
+
+   for(r = 0; r < glyphCount; ++r)
+   {
+      int slot = lcd1602_glyph(c, glyphs[r]);
+
+      /* A slot loaded for an earlier glyph of this font may have been evicted to make room */
+      for(col = 0; col < r && slot >= 0; ++col)
+      {
+         if(slots[col] == slot)
+            slot = -1;
+      }
+      if(slot < 0)
+      {
+         SERR("[%s] No free CGRAM slot for large font", __func__);
+         sys_mutex_unlock(c->mutex);
+         return -1;
+      }
+      slots[r] = (uint8_t) slot;
+   }
+
+   for(count = 0; count < length; ++count)
+   {
+      char ch = s[count];
+
+      for(r = 0; r < height; ++r)
+      {
+         int index = lcd1602_cell_index(row + r, column + count * (LCD1602_BIG_WIDTH + 1));
+
+         for(col = 0; col < LCD1602_BIG_WIDTH; ++col)
+         {
+            uint8_t code = BIG_SPACE;
+
+            if(ch >= '0' && ch <= '9')
+               code = (2 == height) ? big2_digits[ch - '0'][r][col] : big4_cell(big4_digits[ch - '0'], r, col);
+            else if('-' == ch)
+               code = (2 == height) ? big2_minus[r][col] : big4_cell(big4_minus, r, col);
+
+            if(BIG_SPACE == code)
+               code = ' ';
+            else if(code < LCD1602_BIG_GLYPHS)
+               code = slots[code];
+            c->shadow.ddram[index + col] = code;
+         }
+
+         if(count + 1 < length)
+            c->shadow.ddram[index + LCD1602_BIG_WIDTH] = ' ';
+      }
+   }
+
+   result = lcd1602_update(c);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
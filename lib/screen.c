@@ -0,0 +1,88 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 off-screen pages
+ */
+#include <malloc.h>
+#include <string.h>
+#include "lcd1602_protocol.h"
+#include "lcd1602_private.h"
+#include "helpers.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+typedef struct lcd1602_screen_s
+{
+   uint16_t rows;
+   uint16_t columns;
+   uint8_t ddram[LCD1602_DDRAM_SIZE]; /* laid out like the controller's DDRAM */
+} lcd1602_screen_t;
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+lcd1602_screen lcd1602_screen_create(uint16_t rows, uint16_t columns)
+{
+   lcd1602_screen_t *s;
+
+   /* Rows 2 and 3 share DDRAM lines with rows 0 and 1, so only 1- and 2-row screens can be
+      wider than LCD1602_MAX_COLUMNS */
+   if(0 == rows || 0 == columns || rows > LCD1602_MAX_ROWS
+   || columns > ((rows > 2) ? LCD1602_MAX_COLUMNS : LCD1602_DDRAM_LINE_LENGTH))
+   {
+      SERR("[%s] Unsupported screen size %ux%u", __func__, rows, columns);
+      return NULL;
+   }
+
+   s = (lcd1602_screen_t *) malloc(sizeof(*s));
+   if(NULL == s)
+      return NULL;
+   s->rows = rows;
+   s->columns = columns;
+   memset(s->ddram, ' ', sizeof(s->ddram));
+   return (lcd1602_screen) s;
+}
+
+void lcd1602_screen_destroy(lcd1602_screen screen)
+{
+   free(screen);
+}
+
+int lcd1602_screen_clear(lcd1602_screen screen)
+{
+   lcd1602_screen_t *s = (lcd1602_screen_t *) screen;
+   memset(s->ddram, ' ', sizeof(s->ddram));
+   return 0;
+}
+
+int lcd1602_screen_string(lcd1602_screen screen, uint16_t row, uint16_t column, const char *str)
+{
+   lcd1602_screen_t *s = (lcd1602_screen_t *) screen;
+   int index;
+
+   if(row >= s->rows || column >= s->columns)
+      return -1;
+
+   index = lcd1602_cell_index(row, column);
+   for(; column < s->columns && *str != '\0'; ++column, ++str)
+      s->ddram[index++] = (uint8_t) *str;
+   return 0;
+}
+
+int lcd1602_screen_show(lcd1602_context context, lcd1602_screen screen, uint16_t column)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   lcd1602_screen_t *s = (lcd1602_screen_t *) screen;
+   int result;
+
+   if(column >= s->columns || (column > 0 && s->rows > 2))
+      return -1;
+
+   sys_mutex_lock(c->mutex);
+   memcpy(c->shadow.ddram, s->ddram, sizeof(c->shadow.ddram));
+   c->shadow.displayShift = (uint8_t) column;
+   result = lcd1602_update(c);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
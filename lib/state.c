@@ -0,0 +1,140 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 controller state model
+ */
+#include <string.h>
+#include "lcd1602_protocol.h"
+#include "lcd1602_private.h"
+
+/* -----------------------------------------------------------------------------------------------------------
+ * DDRAM address mapping
+ *
+ * In 2-line mode the HD44780 DDRAM is two 40-byte lines at addresses 0x00-0x27 and 0x40-0x67. The model
+ * stores both lines back-to-back, which makes the address counter a simple ring: incrementing past 0x27
+ * continues at 0x40, and incrementing past 0x67 wraps to 0x00, exactly like the controller.
+ */
+
+/* Returns the DDRAM index of a display cell, or -1 if the cell doesn't exist */
+int lcd1602_cell_index(uint16_t row, uint16_t column)
+{
+   uint8_t address;
+
+   if(row >= LCD1602_MAX_ROWS || column >= LCD1602_DDRAM_LINE_LENGTH)
+      return -1;
+   address = LCD1602_ROW_OFFSET[row];
+   if((address & 0x3f) + column >= LCD1602_DDRAM_LINE_LENGTH)
+      return -1;
+   return lcd1602_ddram_index(address + column);
+}
+
+uint8_t lcd1602_ddram_index(uint8_t address)
+{
+   return ((address & 0x40) ? LCD1602_DDRAM_LINE_LENGTH : 0)
+        + ((address & 0x3f) % LCD1602_DDRAM_LINE_LENGTH);
+}
+
+uint8_t lcd1602_ddram_address(uint8_t index)
+{
+   return (index < LCD1602_DDRAM_LINE_LENGTH) ? index : (0x40 + index - LCD1602_DDRAM_LINE_LENGTH);
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * State model
+ */
+
+void lcd1602_state_reset(lcd1602_state_t *s)
+{
+   memset(s, 0, sizeof(*s));
+   memset(s->ddram, ' ', sizeof(s->ddram));
+   s->entryMode = LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT;
+   s->displayControl = LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY;
+}
+
+static void lcd1602_state_step(lcd1602_state_t *s, bool forward)
+{
+   if(s->cgramSelected)
+      s->address = (s->address + ((forward) ? 1 : -1)) & (LCD1602_CGRAM_SIZE - 1);
+   else
+      s->address = (s->address + ((forward) ? 1 : LCD1602_DDRAM_SIZE - 1)) % LCD1602_DDRAM_SIZE;
+}
+
+static void lcd1602_state_shift(lcd1602_state_t *s, bool left)
+{
+   s->displayShift = (s->displayShift + ((left) ? 1 : LCD1602_DDRAM_LINE_LENGTH - 1))
+                   % LCD1602_DDRAM_LINE_LENGTH;
+}
+
+void lcd1602_state_apply(lcd1602_state_t *s, uint8_t value, bool isData)
+{
+   bool increment = (s->entryMode & LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT) != 0;
+
+   if(isData)
+   {
+      if(s->cgramSelected)
+         s->cgram[s->address] = value;
+      else
+      {
+         s->ddram[s->address] = value;
+         if(s->entryMode & LCD1602_ENTRY_MODE_SET_FLAG_SHIFT)
+            lcd1602_state_shift(s, increment);
+      }
+      lcd1602_state_step(s, increment);
+   }
+   else if(value & LCD1602_CMD_SET_DDRAM_ADDR)
+   {
+      s->cgramSelected = false;
+      s->address = lcd1602_ddram_index(value & 0x7f);
+   }
+   else if(value & LCD1602_CMD_SET_CGRAM_ADDR)
+   {
+      s->cgramSelected = true;
+      s->address = value & (LCD1602_CGRAM_SIZE - 1);
+   }
+   else if(value & LCD1602_CMD_FUNCTION_SET)
+   {
+      /* Interface width and line count are fixed by lcd1602_reset() */
+   }
+   else if(value & LCD1602_CMD_SHIFT)
+   {
+      if(value & LCD1602_SHIFT_FLAG_DISPLAY)
+         lcd1602_state_shift(s, (value & LCD1602_SHIFT_FLAG_RIGHT) == 0);
+      else
+         lcd1602_state_step(s, (value & LCD1602_SHIFT_FLAG_RIGHT) != 0);
+   }
+   else if(value & LCD1602_CMD_DISPLAY_CONTROL)
+   {
+      s->displayControl = value & (LCD1602_DISPLAY_CONTROL_FLAG_DISPLAY
+                                 | LCD1602_DISPLAY_CONTROL_FLAG_CURSOR
+                                 | LCD1602_DISPLAY_CONTROL_FLAG_BLINK);
+   }
+   else if(value & LCD1602_CMD_ENTRY_MODE_SET)
+   {
+      s->entryMode = value & (LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT | LCD1602_ENTRY_MODE_SET_FLAG_SHIFT);
+   }
+   else if(value & LCD1602_CMD_HOME)
+   {
+      s->cgramSelected = false;
+      s->address = 0;
+      s->displayShift = 0;
+   }
+   else if(value & LCD1602_CMD_CLEAR)
+   {
+      memset(s->ddram, ' ', sizeof(s->ddram));
+      s->cgramSelected = false;
+      s->address = 0;
+      s->displayShift = 0;
+      s->entryMode |= LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT;
+   }
+}
+
+/* Compares everything the controller would show, optionally ignoring the address counter */
+bool lcd1602_state_equal(const lcd1602_state_t *a, const lcd1602_state_t *b, bool ignoreAddress)
+{
+   if(!ignoreAddress && (a->cgramSelected != b->cgramSelected || a->address != b->address))
+      return false;
+   return a->entryMode == b->entryMode
+       && a->displayControl == b->displayControl
+       && a->displayShift == b->displayShift
+       && memcmp(a->ddram, b->ddram, sizeof(a->ddram)) == 0
+       && memcmp(a->cgram, b->cgram, sizeof(a->cgram)) == 0;
+}
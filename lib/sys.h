@@ -14,6 +14,7 @@
 #define _SYS_PORTABILITY_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #if defined(__linux__)
    #include "sys_linux.h"
@@ -38,14 +39,10 @@ bool i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
 bool i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length);
 bool i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
 bool i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length);
+bool i2c_ll_set_speed(i2c_lowlevel_context ctx, uint32_t i2c_speed);
 
 /* time */
-#if defined(ESP_PLATFORM)
-   #include "rom/ets_sys.h"  /* ets_delay_us */
-   __inline int sys_delay_us(size_t x) { ets_delay_us(x); return 0; }
-#elif defined(__linux__)
-   #define sys_delay_us(x) usleep(x)
-#endif
+int sys_delay_us(size_t x); /* yields the CPU for all but very short delays */
 uint64_t sys_microsecond_tick(void);
 
 /* mutex */
@@ -0,0 +1,292 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 timing profiles and calibration
+ */
+#include <string.h>
+#include <inttypes.h>
+#include "lcd1602_protocol.h"
+#include "lcd1602_private.h"
+#include "helpers.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+#define LCD1602_CALIBRATE_TRIALS  4  /* passes every candidate profile must survive */
+#define LCD1602_CALIBRATE_MARGIN  25 /* percent added to the shortest delays that passed */
+#define LCD1602_CGRAM_DATA_MASK   0x1f
+
+const lcd1602_timing lcd1602_timing_default = {
+   LCD1602_I2C_SPEED, LCD1602_DELAY_ENABLE_PULSE_SETTLE, LCD1602_DELAY_CLEAR, LCD1602_DELAY_ENTRY_MODE_SET
+};
+
+/* Candidates, tried in order until one fails */
+static const uint32_t calibrate_speed[] = { 700000, 1000000 };
+static const uint32_t calibrate_settle[] = { 30, 24, 18, 12 };
+static const uint32_t calibrate_clear[] = { 1300, 1000, 800, 600 };
+static const uint32_t calibrate_mode_set[] = { 1640, 400, 100, 40 };
+
+#define CALIBRATE_COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+typedef enum
+{
+   CALIBRATE_SETTLE,
+   CALIBRATE_CLEAR,
+   CALIBRATE_MODE_SET
+} eCalibrateDelay;
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Private Helper Functions
+ */
+
+static int timing_apply(lcd1602_t *c, const lcd1602_timing *timing)
+{
+   if(lcd1602_frame_flush(c) != 0)
+      return -1;
+   if(timing->busSpeed != c->timing.busSpeed)
+   {
+      if(NULL == c->transport->set_speed || !c->transport->set_speed(c->i2c, timing->busSpeed))
+         return -1;
+      c->speedConfirmed = true;
+   }
+   c->timing = *timing;
+   return 0;
+}
+
+static uint32_t *timing_delay(lcd1602_timing *timing, eCalibrateDelay delay)
+{
+   switch(delay)
+   {
+      case CALIBRATE_CLEAR:
+         return &timing->clear;
+      case CALIBRATE_MODE_SET:
+         return &timing->modeSet;
+      case CALIBRATE_SETTLE:
+      default:
+         return &timing->settle;
+   }
+}
+
+static uint8_t calibrate_pattern(uint8_t seed, uint8_t index)
+{
+   return (uint8_t) ((index * 7 + seed * 13) ^ (index >> 3)) & LCD1602_CGRAM_DATA_MASK;
+}
+
+/* Reads back "count" CGRAM bytes starting at "address" and compares them with the expected pattern */
+static int calibrate_read_back(lcd1602_t *c, uint8_t address, uint8_t count, uint8_t seed, uint8_t step)
+{
+   uint8_t index, value;
+
+   if(lcd1602_write_byte(c, LCD1602_CMD_SET_CGRAM_ADDR | address, false, 0) != 0)
+      return -1;
+   for(index = 0; index < count; ++index)
+   {
+      if(lcd1602_read_byte(c, true, &value) != 0
+      || (value & LCD1602_CGRAM_DATA_MASK) != calibrate_pattern(seed, address + index * step))
+         return -1;
+      if(step > 1 && index + 1 < count
+      && lcd1602_write_byte(c, LCD1602_CMD_SET_CGRAM_ADDR | (address + (index + 1) * step), false, 0) != 0)
+         return -1;
+   }
+   return 0;
+}
+
+/* Fills the CGRAM with back-to-back writes. A write that arrived while the controller was busy is lost,
+   which shows up in the address counter; one that was latched incorrectly shows up in the data. */
+static int calibrate_check_writes(lcd1602_t *c, uint8_t seed)
+{
+   uint8_t index, status;
+
+   if(lcd1602_write_byte(c, LCD1602_CMD_SET_CGRAM_ADDR, false, 0) != 0)
+      return -1;
+   for(index = 0; index < LCD1602_CGRAM_SIZE; ++index)
+   {
+      if(lcd1602_write_byte(c, calibrate_pattern(seed, index), true, 0) != 0)
+         return -1;
+   }
+
+   /* The controller must be idle by now, with the address counter 64 writes on. The counter has 7 bits,
+      so it reads 0x40 or, on controllers that wrap at the end of CGRAM, 0x00. */
+   if(lcd1602_read_byte(c, false, &status) != 0 || (status & LCD1602_STATUS_BUSY)
+   || (status & (LCD1602_CGRAM_SIZE - 1)) != 0)
+      return -1;
+   return calibrate_read_back(c, 0, LCD1602_CGRAM_SIZE, seed, 1);
+}
+
+/* Follows a slow instruction with a CGRAM write after the given delay. If the controller was still busy,
+   the set-address or the write is lost. */
+static int calibrate_check_delay(lcd1602_t *c, uint8_t instruction, uint32_t delay, uint8_t seed)
+{
+   uint8_t slot;
+
+   for(slot = 0; slot < LCD1602_CGRAM_SLOTS; ++slot)
+   {
+      uint8_t address = slot * LCD1602_GLYPH_SIZE;
+      if(lcd1602_write_byte(c, instruction, false, delay) != 0
+      || lcd1602_frame_flush(c) != 0
+      || lcd1602_write_byte(c, LCD1602_CMD_SET_CGRAM_ADDR | address, false, 0) != 0
+      || lcd1602_write_byte(c, calibrate_pattern(seed, address), true, 0) != 0)
+         return -1;
+   }
+   return calibrate_read_back(c, 0, LCD1602_CGRAM_SLOTS, seed, LCD1602_GLYPH_SIZE);
+}
+
+/* Applies a profile and checks that the panel handles it */
+static bool calibrate_verify(lcd1602_t *c, const lcd1602_timing *timing)
+{
+   uint8_t trial;
+   bool ok = true;
+
+   if(timing_apply(c, timing) != 0)
+   {
+      SDBG("[%s] %" PRIu32 " Hz not available", __func__, timing->busSpeed);
+      return false; /* nothing was sent with the profile */
+   }
+
+   for(trial = 0; trial < LCD1602_CALIBRATE_TRIALS && ok; ++trial)
+   {
+      /* Every check writes a different pattern, so that a lost write can't leave matching data behind */
+      ok = calibrate_check_writes(c, trial * 3) == 0
+        && calibrate_check_delay(c, LCD1602_CMD_HOME, timing->clear, trial * 3 + 1) == 0
+        && calibrate_check_delay(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                                 timing->modeSet, trial * 3 + 2) == 0;
+   }
+
+   if(!ok)
+   {
+      /* A lost nibble may have left the interface out of step */
+      SDBG("[%s] %" PRIu32 " Hz, settle %" PRIu32 ", clear %" PRIu32 ", mode %" PRIu32 " failed", __func__,
+         timing->busSpeed, timing->settle, timing->clear, timing->modeSet);
+      timing_apply(c, &lcd1602_timing_default);
+      lcd1602_resync(c);
+      lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                         false, c->timing.modeSet);
+   }
+   return ok;
+}
+
+/* Shortens one delay of the best profile for as long as the panel keeps up */
+static void calibrate_search(lcd1602_t *c, lcd1602_timing *best, eCalibrateDelay delay,
+   const uint32_t *candidates, size_t count)
+{
+   lcd1602_timing trial;
+   size_t i;
+
+   for(i = 0; i < count && candidates[i] < *timing_delay(best, delay); ++i)
+   {
+      trial = *best;
+      *timing_delay(&trial, delay) = candidates[i];
+      if(!calibrate_verify(c, &trial))
+         break;
+      *timing_delay(best, delay) = candidates[i];
+   }
+}
+
+static uint32_t calibrate_margin(uint32_t delay, uint32_t limit)
+{
+   delay = (delay * (100 + LCD1602_CALIBRATE_MARGIN) + 99) / 100;
+   return (delay > limit) ? limit : delay;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+int lcd1602_get_timing(lcd1602_context context, lcd1602_timing *timing)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   sys_mutex_lock(c->mutex);
+   *timing = c->timing;
+   sys_mutex_unlock(c->mutex);
+   return 0;
+}
+
+int lcd1602_set_timing(lcd1602_context context, const lcd1602_timing *timing)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   int result;
+
+   if(0 == timing->busSpeed || 0 == timing->settle)
+      return -1;
+
+   sys_mutex_lock(c->mutex);
+   result = timing_apply(c, timing);
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+int lcd1602_calibrate(lcd1602_context context, lcd1602_timing *timing)
+{
+   lcd1602_t *c = (lcd1602_t *) context;
+   lcd1602_timing best = lcd1602_timing_default;
+   int result = 0;
+   size_t i;
+
+   sys_mutex_lock(c->mutex);
+
+   if(lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                         false, c->timing.modeSet) != 0
+   || !calibrate_verify(c, &best))
+   {
+      SERR("[%s] Panel failed verification at default timing (reads unsupported?)", __func__);
+      result = -1;
+   }
+   else
+   {
+      for(i = 0; i < CALIBRATE_COUNT(calibrate_speed); ++i)
+      {
+         lcd1602_timing trial = best;
+         trial.busSpeed = calibrate_speed[i];
+         if(!calibrate_verify(c, &trial))
+            break;
+         best.busSpeed = calibrate_speed[i];
+      }
+      calibrate_search(c, &best, CALIBRATE_SETTLE, calibrate_settle, CALIBRATE_COUNT(calibrate_settle));
+      calibrate_search(c, &best, CALIBRATE_CLEAR, calibrate_clear, CALIBRATE_COUNT(calibrate_clear));
+      calibrate_search(c, &best, CALIBRATE_MODE_SET, calibrate_mode_set, CALIBRATE_COUNT(calibrate_mode_set));
+
+      best.settle = calibrate_margin(best.settle, lcd1602_timing_default.settle);
+      best.clear = calibrate_margin(best.clear, lcd1602_timing_default.clear);
+      best.modeSet = calibrate_margin(best.modeSet, lcd1602_timing_default.modeSet);
+      if(!calibrate_verify(c, &best))
+      {
+         SERR("[%s] Calibrated profile failed verification; using defaults", __func__);
+         result = -1;
+      }
+   }
+
+   if(0 != result)
+      timing_apply(c, &lcd1602_timing_default);
+   SDBG("[%s] %" PRIu32 " Hz, settle %" PRIu32 " us, clear %" PRIu32 " us, mode %" PRIu32 " us", __func__,
+      c->timing.busSpeed, c->timing.settle, c->timing.clear, c->timing.modeSet);
+
+   /* The checks overwrote the CGRAM and moved the display, so redraw everything */
+   c->panelGlyphs = 0;
+   if(lcd1602_write_byte(c, LCD1602_CMD_CLEAR, false, c->timing.clear) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_ENTRY_MODE_SET | LCD1602_ENTRY_MODE_SET_FLAG_INCREMENT,
+                         false, c->timing.modeSet) != 0
+   || lcd1602_write_byte(c, LCD1602_CMD_DISPLAY_CONTROL | c->panel.displayControl,
+                         false, c->timing.modeSet) != 0
+   || lcd1602_sync(c) != 0)
+      result = -1;
+
+   if(NULL != timing)
+      *timing = c->timing;
+   sys_mutex_unlock(c->mutex);
+
+   return result;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Internal Functions
+ */
+
+/* Caller must hold c->mutex. Returns to the default profile after a transfer error. */
+void lcd1602_timing_fallback(lcd1602_t *c)
+{
+   if(memcmp(&c->timing, &lcd1602_timing_default, sizeof(c->timing)) == 0)
+      return;
+   SERR("[%s] Transfer failed; returning to default timing", __func__);
+   c->speedConfirmed = (NULL != c->transport->set_speed
+                        && c->transport->set_speed(c->i2c, lcd1602_timing_default.busSpeed));
+   c->timing = lcd1602_timing_default;
+}
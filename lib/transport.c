@@ -0,0 +1,54 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief lcd1602 transport over the system portability layer
+ */
+#include "lcd1602_protocol.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Private Helper Functions
+ */
+
+static void *sys_transport_open(const void *config, uint8_t i2cAddress, uint32_t busSpeed, uint32_t timeoutMs,
+   lcd1602_transport_caps *caps)
+{
+   caps->maxWrite = LCD1602_MAX_TRANSFER_SIZE;
+   caps->read = true;
+   caps->vectored = false;
+   return i2c_ll_init(i2cAddress, busSpeed, timeoutMs, (i2c_lowlevel_config *) config);
+}
+
+static void sys_transport_close(void *handle)
+{
+   i2c_ll_deinit(handle);
+}
+
+static bool sys_transport_write(void *handle, const uint8_t *data, uint16_t length)
+{
+   return length <= LCD1602_MAX_TRANSFER_SIZE && i2c_ll_write(handle, (uint8_t *) data, (uint8_t) length);
+}
+
+static bool sys_transport_read(void *handle, uint8_t *data, uint16_t length)
+{
+   return length <= LCD1602_MAX_TRANSFER_SIZE && i2c_ll_read(handle, data, (uint8_t) length);
+}
+
+static bool sys_transport_set_speed(void *handle, uint32_t busSpeed)
+{
+   return i2c_ll_set_speed(handle, busSpeed);
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Data
+ */
+
+const lcd1602_transport lcd1602_transport_sys = {
+   .name = "sys",
+   .open = sys_transport_open,
+   .close = sys_transport_close,
+   .write = sys_transport_write,
+   .read = sys_transport_read,
+   .transfer = NULL,
+   .set_speed = sys_transport_set_speed
+};
@@ -0,0 +1,410 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Simulated PCF8574 and HD44780 (Linux)
+ *
+ * Models the controller in 4-bit mode behind the PCF8574, at the level of the bytes the PCF8574
+ * drives onto the controller's pins: instructions are latched on the falling edge of E, reads are
+ * answered while E is high, and anything written while the controller is busy is ignored and
+ * counted as a violation, as real hardware would drop it.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lcd1602/lcd1602_virtual.h"
+#include "virtual.h"
+#include "helpers.h"
+#include "sys.h"
+#include "lcd1602.h"
+
+#define VIRTUAL_BITS_PER_BYTE     9
+#define VIRTUAL_EXEC_CLEAR_HOME   1520  /* microseconds, at the datasheet's 270 kHz oscillator */
+#define VIRTUAL_EXEC_DEFAULT      37
+#define VIRTUAL_EXEC_POWER_ON     15000
+#define VIRTUAL_EXEC_INIT_FIRST   4100  /* first 8-bit function set of initialization by instruction */
+#define VIRTUAL_EXEC_INIT_SECOND  100
+#define VIRTUAL_ENABLE_PULSE_NS   450
+
+#define PIN_RS     0x01
+#define PIN_RW     0x02
+#define PIN_E      0x04
+#define PIN_BL     0x08
+
+struct virtual_panel_s
+{
+   lcd1602_virtual_panel *panel; /* shared memory if named, heap otherwise */
+   char *name;
+
+   uint32_t busSpeed;     /* hz */
+   bool followSpeed;      /* busSpeed tracks the speed the library selects */
+   uint32_t execPercent;
+   bool zeroLatency;
+   uint64_t busFree;      /* nanoseconds; when the last transfer finished */
+
+   bool eightBit;
+   bool pendingNibble;    /* 4-bit mode: upper nibble received */
+   uint8_t upper;
+   uint32_t initSteps;    /* 8-bit function sets received, for initialization timing */
+   uint8_t output;        /* PCF8574 output latch */
+   uint64_t enableRise;
+   uint64_t busyUntil;
+   bool readLower;        /* next read nibble is the lower one */
+   uint8_t readValue;
+   uint8_t readNibble;
+};
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Controller model
+ */
+
+static uint64_t virtual_now(void)
+{
+   return sys_microsecond_tick() * 1000;
+}
+
+static void virtual_step(lcd1602_virtual_panel *p, bool forward)
+{
+   if(p->cgramSelected)
+   {
+      p->address = (p->address + ((forward) ? 1 : -1)) & 0x7f; /* the counter has 7 bits */
+      return;
+   }
+   if(forward)
+      p->address = (0x27 == p->address) ? 0x40 : (0x67 == p->address) ? 0x00 : p->address + 1;
+   else
+      p->address = (0x40 == p->address) ? 0x27 : (0x00 == p->address) ? 0x67 : p->address - 1;
+}
+
+static void virtual_shift(lcd1602_virtual_panel *p, bool left)
+{
+   p->displayShift = (p->displayShift + ((left) ? 1 : LCD1602_VIRTUAL_LINE_LENGTH - 1))
+                   % LCD1602_VIRTUAL_LINE_LENGTH;
+}
+
+static void virtual_execute(virtual_panel_t *v, uint8_t value, bool isData, uint64_t time)
+{
+   lcd1602_virtual_panel *p = v->panel;
+   uint32_t exec = VIRTUAL_EXEC_DEFAULT;
+
+   if(time < v->busyUntil)
+   {
+      p->violations += 1;
+      return;
+   }
+   p->instructions += 1;
+
+   if(isData)
+   {
+      if(p->cgramSelected)
+         p->cgram[p->address & 0x3f] = value;
+      else
+      {
+         p->ddram[p->address & 0x7f] = value;
+         if(p->entryMode & 0x01)
+            virtual_shift(p, (p->entryMode & 0x02) != 0);
+      }
+      virtual_step(p, (p->entryMode & 0x02) != 0);
+   }
+   else if(value & 0x80)
+   {
+      p->cgramSelected = false;
+      p->address = value & 0x7f;
+   }
+   else if(value & 0x40)
+   {
+      p->cgramSelected = true;
+      p->address = value & 0x3f;
+   }
+   else if(value & 0x20)
+   {
+      if(v->eightBit && (value & 0x10))
+      {
+         ++v->initSteps;
+         if(1 == v->initSteps)
+            exec = VIRTUAL_EXEC_INIT_FIRST;
+         else if(2 == v->initSteps)
+            exec = VIRTUAL_EXEC_INIT_SECOND;
+      }
+      v->eightBit = (value & 0x10) != 0;
+      v->pendingNibble = false;
+   }
+   else if(value & 0x10)
+   {
+      if(value & 0x08)
+         virtual_shift(p, (value & 0x04) == 0);
+      else
+         virtual_step(p, (value & 0x04) != 0);
+   }
+   else if(value & 0x08)
+      p->displayControl = value & 0x07;
+   else if(value & 0x04)
+      p->entryMode = value & 0x03;
+   else if(value & 0x02)
+   {
+      p->cgramSelected = false;
+      p->address = 0;
+      p->displayShift = 0;
+      exec = VIRTUAL_EXEC_CLEAR_HOME;
+   }
+   else if(value & 0x01)
+   {
+      memset(p->ddram, ' ', sizeof(p->ddram));
+      p->cgramSelected = false;
+      p->address = 0;
+      p->displayShift = 0;
+      p->entryMode |= 0x02;
+      exec = VIRTUAL_EXEC_CLEAR_HOME;
+   }
+
+   if(v->zeroLatency)
+      return;
+   if(v->busyUntil < time)
+      v->busyUntil = time;
+   v->busyUntil += (uint64_t) exec * 10 * v->execPercent;
+}
+
+/* The PCF8574 drives its outputs at the end of each byte; the controller latches on the falling edge
+   of E. While RW is high, the controller drives D4-D7 from the rising edge of E. */
+static void virtual_output(virtual_panel_t *v, uint8_t value, uint64_t time)
+{
+   lcd1602_virtual_panel *p = v->panel;
+   bool rise = !(v->output & PIN_E) && (value & PIN_E);
+   bool fall = (v->output & PIN_E) && !(value & PIN_E);
+   uint8_t latched = v->output;
+
+   v->output = value;
+   p->backlight = (value & PIN_BL) != 0;
+   if(rise)
+   {
+      v->enableRise = time;
+      if(value & PIN_RW)
+      {
+         if(!v->readLower)
+         {
+            if(value & PIN_RS)
+               v->readValue = (p->cgramSelected) ? p->cgram[p->address & 0x3f] : p->ddram[p->address & 0x7f];
+            else
+               v->readValue = ((time < v->busyUntil) ? 0x80 : 0) | p->address;
+         }
+         v->readNibble = (v->readLower) ? (v->readValue << 4) : (v->readValue & 0xf0);
+      }
+   }
+   if(!fall)
+      return;
+
+   if(!v->zeroLatency && time - v->enableRise < VIRTUAL_ENABLE_PULSE_NS)
+      p->violations += 1;
+
+   if(latched & PIN_RW)
+   {
+      if(v->readLower && (latched & PIN_RS))
+         virtual_step(p, (p->entryMode & 0x02) != 0); /* data reads advance the address counter */
+      v->readLower = !v->readLower;
+      return;
+   }
+
+   if(v->eightBit)
+      virtual_execute(v, latched & 0xf0, latched & PIN_RS, time);
+   else if(!v->pendingNibble)
+   {
+      v->upper = latched & 0xf0;
+      v->pendingNibble = true;
+   }
+   else
+   {
+      v->pendingNibble = false;
+      virtual_execute(v, v->upper | (latched >> 4), latched & PIN_RS, time);
+   }
+}
+
+/* Returns the time, in nanoseconds, when the address byte of a transfer of "length" bytes ends */
+static uint64_t virtual_transfer_start(virtual_panel_t *v, uint8_t length, uint64_t *byteTime)
+{
+   uint64_t now = virtual_now();
+   uint64_t start = (v->busFree > now) ? v->busFree : now;
+
+   *byteTime = (v->zeroLatency || 0 == v->busSpeed)
+             ? 0 : (uint64_t) VIRTUAL_BITS_PER_BYTE * 1000000000 / v->busSpeed;
+   v->busFree = start + (length + 1) * (*byteTime);
+   return start + *byteTime;
+}
+
+/* Transfers are synchronous, as they are on a real i2c-dev adapter */
+static void virtual_transfer_wait(virtual_panel_t *v)
+{
+   uint64_t now = virtual_now();
+   if(v->busFree > now)
+      sys_delay_us((v->busFree - now + 999) / 1000);
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bool virtual_device(const char *device)
+{
+   size_t length = strlen(VIRTUAL_DEVICE_PREFIX);
+   return NULL != device && strncmp(device, VIRTUAL_DEVICE_PREFIX, length) == 0
+       && ('\0' == device[length] || ':' == device[length]);
+}
+
+virtual_panel_t *virtual_init(uint32_t i2c_speed, i2c_lowlevel_config *config)
+{
+   const char *name = (NULL == config->device) ? NULL : strchr(config->device, ':');
+   virtual_panel_t *v = (virtual_panel_t *) calloc(1, sizeof(*v));
+   if(NULL == v)
+      return NULL;
+
+   if(NULL == name)
+      v->panel = (lcd1602_virtual_panel *) calloc(1, sizeof(*v->panel));
+   else
+   {
+      int fd;
+
+      v->name = strdup(name + 1);
+      fd = (NULL == v->name) ? -1 : shm_open(v->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if(fd < 0)
+      {
+         SERR("[%s] Failed to create shared memory '%s'", __func__, name + 1);
+      }
+      else
+      {
+         fchmod(fd, 0644); /* any local process may inspect the panel */
+         if(ftruncate(fd, sizeof(*v->panel)) == 0)
+         {
+            v->panel = (lcd1602_virtual_panel *) mmap(NULL, sizeof(*v->panel), PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED, fd, 0);
+            if(MAP_FAILED == v->panel)
+               v->panel = NULL;
+         }
+         close(fd);
+      }
+   }
+   if(NULL == v->panel)
+   {
+      virtual_deinit(v);
+      return NULL;
+   }
+
+   v->followSpeed = (0 == config->virtual_bus_speed);
+   v->busSpeed = (v->followSpeed) ? i2c_speed : config->virtual_bus_speed;
+   v->execPercent = (0 == config->virtual_exec_percent) ? 100 : config->virtual_exec_percent;
+   v->zeroLatency = config->virtual_zero_latency;
+
+   /* Power-on state */
+   v->eightBit = true;
+   if(!v->zeroLatency)
+      v->busyUntil = virtual_now() + (uint64_t) VIRTUAL_EXEC_POWER_ON * 10 * v->execPercent;
+   memset(v->panel->ddram, ' ', sizeof(v->panel->ddram));
+   v->panel->entryMode = 0x02;
+   v->panel->version = LCD1602_VIRTUAL_VERSION;
+   __atomic_store_n(&v->panel->magic, LCD1602_VIRTUAL_MAGIC, __ATOMIC_RELEASE);
+
+   return v;
+}
+
+void virtual_deinit(virtual_panel_t *v)
+{
+   if(NULL != v->panel)
+   {
+      if(NULL != v->name)
+      {
+         munmap(v->panel, sizeof(*v->panel));
+         shm_unlink(v->name);
+      }
+      else
+         free(v->panel);
+   }
+   free(v->name);
+   free(v);
+}
+
+bool virtual_write(virtual_panel_t *v, const uint8_t *data, uint8_t length)
+{
+   lcd1602_virtual_panel *p = v->panel;
+   uint64_t byteTime, time = virtual_transfer_start(v, length, &byteTime);
+   uint8_t i;
+
+   __atomic_store_n(&p->sequence, p->sequence + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE); /* odd sequence is visible before anything changes */
+   for(i = 0; i < length; ++i)
+   {
+      time += byteTime;
+      virtual_output(v, data[i], time);
+   }
+   p->bytes += length;
+   p->transfers += 1;
+   __atomic_store_n(&p->sequence, p->sequence + 1, __ATOMIC_RELEASE);
+
+   virtual_transfer_wait(v);
+   return true;
+}
+
+bool virtual_read(virtual_panel_t *v, uint8_t *data, uint8_t length)
+{
+   uint64_t byteTime;
+
+   virtual_transfer_start(v, length, &byteTime);
+   memset(data, v->readNibble | (v->output & 0x0f), length);
+   virtual_transfer_wait(v);
+   return true;
+}
+
+bool virtual_set_speed(virtual_panel_t *v, uint32_t i2c_speed)
+{
+   if(v->followSpeed)
+      v->busSpeed = i2c_speed;
+   return true;
+}
+
+/* -----------------------------------------------------------------------------------------------------------
+ * Transport
+ */
+
+static void *virtual_transport_open(const void *config, uint8_t i2cAddress, uint32_t busSpeed, uint32_t timeoutMs,
+   lcd1602_transport_caps *caps)
+{
+   (void) i2cAddress;
+   (void) timeoutMs;
+   if(NULL == config)
+   {
+      SERR("[%s] Missing configuration", __func__);
+      return NULL;
+   }
+   caps->maxWrite = UINT8_MAX;
+   caps->read = true;
+   caps->vectored = false;
+   return virtual_init(busSpeed, (i2c_lowlevel_config *) config);
+}
+
+static void virtual_transport_close(void *handle)
+{
+   virtual_deinit((virtual_panel_t *) handle);
+}
+
+static bool virtual_transport_write(void *handle, const uint8_t *data, uint16_t length)
+{
+   return length <= UINT8_MAX && virtual_write((virtual_panel_t *) handle, data, (uint8_t) length);
+}
+
+static bool virtual_transport_read(void *handle, uint8_t *data, uint16_t length)
+{
+   return length <= UINT8_MAX && virtual_read((virtual_panel_t *) handle, data, (uint8_t) length);
+}
+
+static bool virtual_transport_set_speed(void *handle, uint32_t busSpeed)
+{
+   return virtual_set_speed((virtual_panel_t *) handle, busSpeed);
+}
+
+const lcd1602_transport lcd1602_transport_virtual = {
+   .name = "virtual",
+   .open = virtual_transport_open,
+   .close = virtual_transport_close,
+   .write = virtual_transport_write,
+   .read = virtual_transport_read,
+   .transfer = NULL,
+   .set_speed = virtual_transport_set_speed
+};
@@ -0,0 +1,23 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Simulated PCF8574 and HD44780 (Linux)
+ */
+#ifndef _VIRTUAL_H
+#define _VIRTUAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sys_linux.h"
+
+#define VIRTUAL_DEVICE_PREFIX "virtual"
+
+typedef struct virtual_panel_s virtual_panel_t;
+
+bool virtual_device(const char *device);
+virtual_panel_t *virtual_init(uint32_t i2c_speed, i2c_lowlevel_config *config);
+void virtual_deinit(virtual_panel_t *v);
+bool virtual_write(virtual_panel_t *v, const uint8_t *data, uint8_t length);
+bool virtual_read(virtual_panel_t *v, uint8_t *data, uint8_t length);
+bool virtual_set_speed(virtual_panel_t *v, uint32_t i2c_speed);
+
+#endif /* _VIRTUAL_H */